@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatAudioAggregator.h"
+
+#include "Components/AudioComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Sound/SoundBase.h"
+
+UCombatAudioAggregator::UCombatAudioAggregator() : MergeWindow(0.1f),
+MergeRadius(600.f),
+MaxMergedVolume(2.f)
+{
+	VoiceBudgets.Add(ECombatAudioCategory::Impact, 6);
+	VoiceBudgets.Add(ECombatAudioCategory::WeakSpot, 4);
+	VoiceBudgets.Add(ECombatAudioCategory::Death, 6);
+	VoiceBudgets.Add(ECombatAudioCategory::Spawn, 6);
+}
+
+void UCombatAudioAggregator::PlaySound(USoundBase* Sound, const FVector& Location, ECombatAudioCategory Category, USceneComponent* AttachTo, FName SocketName)
+{
+	UWorld* World = GetWorld();
+	if (!Sound || !World)
+		return;
+
+	const float CurrentTime = World->GetTimeSeconds();
+
+	// Same cue, started a moment ago close by: make that voice louder instead of starting a new one
+	for (FCombatVoice& Voice : Voices)
+	{
+		if (Voice.Sound == Sound && CurrentTime - Voice.StartTime <= MergeWindow && FVector::DistSquared(Voice.Location, Location) <= MergeRadius * MergeRadius
+			&& IsValid(Voice.Component) && Voice.Component->IsPlaying())
+		{
+			++Voice.Count;
+			Voice.Component->SetVolumeMultiplier(FMath::Min(FMath::Sqrt(static_cast<float>(Voice.Count)), MaxMergedVolume));
+			++Stats.Merged;
+			return;
+		}
+	}
+
+	const int32* Budget = VoiceBudgets.Find(Category);
+	if (Budget && CountVoices(Category) >= *Budget)
+	{
+		++Stats.Dropped;
+		return;
+	}
+
+	UAudioComponent* Component = AttachTo ? UGameplayStatics::SpawnSoundAttached(Sound, AttachTo, SocketName) : UGameplayStatics::SpawnSoundAtLocation(World, Sound, Location);
+	if (!Component)
+		return;
+
+	FCombatVoice& Voice = Voices.AddDefaulted_GetRef();
+	Voice.Component = Component;
+	Voice.Sound = Sound;
+	Voice.Location = Location;
+	Voice.StartTime = CurrentTime;
+	Voice.Category = Category;
+
+	++Stats.Played;
+}
+
+void UCombatAudioAggregator::Tick()
+{
+	for (int32 i = Voices.Num() - 1; i >= 0; --i)
+	{
+		if (!IsValid(Voices[i].Component) || !Voices[i].Component->IsPlaying())
+			Voices.RemoveAtSwap(i, 1, false);
+	}
+}
+
+int32 UCombatAudioAggregator::CountVoices(ECombatAudioCategory Category) const
+{
+	int32 Count = 0;
+	for (const FCombatVoice& Voice : Voices)
+	{
+		if (Voice.Category == Category && IsValid(Voice.Component) && Voice.Component->IsPlaying())
+			++Count;
+	}
+	return Count;
+}
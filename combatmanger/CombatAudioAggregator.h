@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+
+#include "CombatTypes.h"
+
+#include "CombatAudioAggregator.generated.h"
+
+class USoundBase;
+class UAudioComponent;
+class USceneComponent;
+
+USTRUCT()
+struct CPPSINNER_API FCombatVoice
+{
+	GENERATED_BODY()
+
+	FCombatVoice() : Component(nullptr), Sound(nullptr), Location(FVector::ZeroVector), StartTime(0.f), Count(1), Category(ECombatAudioCategory::Impact) {}
+
+	UPROPERTY()
+	UAudioComponent* Component;
+
+	UPROPERTY()
+	USoundBase* Sound;
+
+	FVector Location;
+
+	float StartTime;
+
+	// how many events this voice stands for
+	int32 Count;
+
+	ECombatAudioCategory Category;
+};
+
+// Merges combat sounds of the same cue that happen close together (in time and space) into one voice with a higher volume,
+// and keeps every category under its voice budget. A wave dying to a rocket plays a handful of voices instead of dozens.
+// Owned by UCombatSubsystem, the limits are set in DefaultGame.ini.
+UCLASS(config = Game)
+class CPPSINNER_API UCombatAudioAggregator : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UCombatAudioAggregator();
+
+	// Plays (or merges) a combat sound. With AttachTo the sound follows that component/socket like SpawnSoundAttached
+	void PlaySound(USoundBase* Sound, const FVector& Location, ECombatAudioCategory Category, USceneComponent* AttachTo = nullptr, FName SocketName = NAME_None);
+
+	// drops voices that finished playing
+	void Tick();
+
+	FORCEINLINE const FCombatAudioStats& GetStats() const { return Stats; }
+
+	// events of the same cue within this many seconds of a voice starting get merged into it
+	UPROPERTY(Config)
+	float MergeWindow;
+
+	UPROPERTY(Config)
+	float MergeRadius;
+
+	// volume multiplier cap of a merged voice, the volume grows with the square root of the merged events
+	UPROPERTY(Config)
+	float MaxMergedVolume;
+
+	// voices that can play at once per category
+	UPROPERTY(Config)
+	TMap<ECombatAudioCategory, int32> VoiceBudgets;
+
+private:
+	int32 CountVoices(ECombatAudioCategory Category) const;
+
+	UPROPERTY()
+	TArray<FCombatVoice> Voices;
+
+	UPROPERTY()
+	FCombatAudioStats Stats;
+};
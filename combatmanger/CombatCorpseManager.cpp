@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatCorpseManager.h"
+
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+
+#include "EnemyBase.h"
+
+UCombatCorpseManager::UCombatCorpseManager() : MaxSimulatingRagdolls(8),
+MaxCorpses(24),
+SettleSpeed(5.f),
+SettleTime(0.5f),
+MaxSimulationTime(4.f),
+NumSimulating(0),
+NumFrozen(0),
+NumEvicted(0)
+{
+}
+
+void UCombatCorpseManager::RegisterCorpse(AEnemyBase* Enemy)
+{
+	UWorld* World = GetWorld();
+	if (!IsValid(Enemy) || !World)
+		return;
+
+	// dying twice (i.e DieFromSpawn on an enemy that just died) must not count the body twice
+	UnregisterCorpse(Enemy);
+
+	const float CurrentTime = World->GetTimeSeconds();
+
+	FCombatCorpse& Corpse = Corpses.AddDefaulted_GetRef();
+	Corpse.Enemy = Enemy;
+	Corpse.DeathTime = CurrentTime;
+	Corpse.LastMovingTime = CurrentTime;
+	Corpse.bSimulating = true;
+	++NumSimulating;
+
+	// the newest death is the one the player looks at, the oldest ragdolls have had the most time to fall
+	for (int32 i = 0; i != Corpses.Num() && NumSimulating > MaxSimulatingRagdolls; ++i)
+	{
+		if (Corpses[i].bSimulating)
+			FreezeCorpse(Corpses[i]);
+	}
+
+	while (Corpses.Num() > MaxCorpses)
+	{
+		// take it out first, SignalDeath unregisters the corpse again
+		const FCombatCorpse Oldest = Corpses[0];
+		Corpses.RemoveAt(0, 1, false);
+		if (Oldest.bSimulating)
+			--NumSimulating;
+
+		++NumEvicted;
+		if (AEnemyBase* OldestEnemy = Oldest.Enemy.Get())
+			OldestEnemy->SignalDeath();
+	}
+}
+
+void UCombatCorpseManager::UnregisterCorpse(AEnemyBase* Enemy)
+{
+	for (int32 i = 0; i != Corpses.Num(); ++i)
+	{
+		if (Corpses[i].Enemy.Get() == Enemy)
+		{
+			if (Corpses[i].bSimulating)
+				--NumSimulating;
+
+			// keep the order, eviction goes by it
+			Corpses.RemoveAt(i, 1, false);
+			return;
+		}
+	}
+}
+
+void UCombatCorpseManager::Tick(float CurrentTime)
+{
+	for (int32 i = Corpses.Num() - 1; i >= 0; --i)
+	{
+		FCombatCorpse& Corpse = Corpses[i];
+		AEnemyBase* Enemy = Corpse.Enemy.Get();
+
+		// destroyed without going through SignalDeath
+		if (!Enemy)
+		{
+			if (Corpse.bSimulating)
+				--NumSimulating;
+			Corpses.RemoveAt(i, 1, false);
+			continue;
+		}
+
+		if (!Corpse.bSimulating)
+			continue;
+
+		// the root body is enough to tell if the ragdoll is still falling
+		if (Enemy->GetMesh()->GetPhysicsLinearVelocity().SizeSquared() > FMath::Square(SettleSpeed))
+			Corpse.LastMovingTime = CurrentTime;
+
+		if (CurrentTime - Corpse.LastMovingTime >= SettleTime || CurrentTime - Corpse.DeathTime >= MaxSimulationTime)
+			FreezeCorpse(Corpse);
+	}
+}
+
+void UCombatCorpseManager::FreezeCorpse(FCombatCorpse& Corpse)
+{
+	Corpse.bSimulating = false;
+	--NumSimulating;
+	++NumFrozen;
+
+	if (AEnemyBase* Enemy = Corpse.Enemy.Get())
+		Enemy->FreezeRagdoll();
+}
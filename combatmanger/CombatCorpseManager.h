@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "CombatCorpseManager.generated.h"
+
+class AEnemyBase;
+
+// Budget for the ragdolls dead enemies leave behind.
+// Only MaxSimulatingRagdolls bodies simulate at once, the oldest one gets frozen when a new one comes in.
+// Bodies that came to rest (or simulated for MaxSimulationTime) are frozen in their last pose: no physics, no skeleton update, no tick.
+// Above MaxCorpses the oldest corpse is cleaned up early through SignalDeath, which hands it back to the enemy pool.
+// Owned by UCombatSubsystem, the limits are set in DefaultGame.ini.
+UCLASS(config = Game)
+class CPPSINNER_API UCombatCorpseManager : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UCombatCorpseManager();
+
+	// Called by the enemy once its ragdoll is simulating
+	void RegisterCorpse(AEnemyBase* Enemy);
+
+	// Called when the corpse gets cleaned up, by its death timer or by eviction
+	void UnregisterCorpse(AEnemyBase* Enemy);
+
+	// freezes corpses that came to rest
+	void Tick(float CurrentTime);
+
+	FORCEINLINE int32 GetNumCorpses() const { return Corpses.Num(); }
+
+	FORCEINLINE int32 GetNumSimulating() const { return NumSimulating; }
+
+	FORCEINLINE int32 GetNumFrozen() const { return NumFrozen; }
+
+	FORCEINLINE int32 GetNumEvicted() const { return NumEvicted; }
+
+	// ragdolls simulating at the same time
+	UPROPERTY(Config)
+	int32 MaxSimulatingRagdolls;
+
+	// corpses lying around at the same time, simulating or frozen
+	UPROPERTY(Config)
+	int32 MaxCorpses;
+
+	// a body slower than this (cm/s) counts as resting
+	UPROPERTY(Config)
+	float SettleSpeed;
+
+	// how long a body has to rest before it gets frozen
+	UPROPERTY(Config)
+	float SettleTime;
+
+	// a body that keeps sliding or twitching is frozen after this anyway
+	UPROPERTY(Config)
+	float MaxSimulationTime;
+
+private:
+	struct FCombatCorpse
+	{
+		TWeakObjectPtr<AEnemyBase> Enemy;
+		float DeathTime;
+
+		// last time the body was faster than SettleSpeed
+		float LastMovingTime;
+
+		bool bSimulating;
+	};
+
+	void FreezeCorpse(FCombatCorpse& Corpse);
+
+	// oldest first, corpses are only ever added at the end
+	TArray<FCombatCorpse> Corpses;
+
+	int32 NumSimulating;
+
+	int32 NumFrozen;
+
+	int32 NumEvicted;
+};
@@ -0,0 +1,179 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatDecalPool.h"
+
+#include "Components/DecalComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+
+#include "CombatSubsystem.h"
+
+UCombatDecalPool::UCombatDecalPool() : MaxDecals(256),
+MergeRadius(20.f),
+EvictionSearch(8),
+Cursor(0),
+NumMerged(0),
+NumEvicted(0)
+{
+}
+
+void UCombatDecalPool::SpawnDecal(UMaterialInterface* Material, const FVector& Size, const FVector& Location, const FRotator& Rotation, float LifeTime)
+{
+	UWorld* World = GetWorld();
+	if (!Material || !World)
+		return;
+
+	const float CurrentTime = World->GetTimeSeconds();
+	const FIntVector Cell = GetCell(Location);
+
+	// a splat right on top of another one of the same material would look the same, just keep the old one alive longer
+	const int32 MergeSlot = FindMergeSlot(Material, Location, Cell);
+	if (MergeSlot != INDEX_NONE)
+	{
+		Slots[MergeSlot].ExpireTime = CurrentTime + LifeTime;
+		++NumMerged;
+		return;
+	}
+
+	const int32 SlotIndex = AcquireSlot(CurrentTime);
+	if (SlotIndex == INDEX_NONE)
+		return;
+
+	FCombatDecalSlot& Slot = Slots[SlotIndex];
+
+	if (!Slot.Decal)
+	{
+		// same outer SpawnDecalAtLocation uses, the component isn't owned by any gameplay actor
+		Slot.Decal = NewObject<UDecalComponent>(World->GetWorldSettings());
+		Slot.Decal->bAllowAnyoneToDestroyMe = true;
+		Slot.Decal->RegisterComponentWithWorld(World);
+	}
+
+	Slot.Decal->SetDecalMaterial(Material);
+	Slot.Decal->DecalSize = Size;
+	Slot.Decal->SetWorldLocationAndRotation(Location, Rotation);
+	Slot.Decal->SetVisibility(true);
+
+	Slot.Location = Location;
+	Slot.Cell = Cell;
+	Slot.LifeTime = LifeTime;
+	Slot.ExpireTime = CurrentTime + LifeTime;
+	Slot.bActive = true;
+
+	CellToSlot.Add(Cell, SlotIndex);
+}
+
+void UCombatDecalPool::Tick(float CurrentTime)
+{
+	for (int32 i = 0; i != Slots.Num(); ++i)
+	{
+		if (Slots[i].bActive && Slots[i].ExpireTime <= CurrentTime)
+			DeactivateSlot(i);
+	}
+}
+
+int32 UCombatDecalPool::FindMergeSlot(UMaterialInterface* Material, const FVector& Location, const FIntVector& Cell) const
+{
+	// the closest splat of the same material within MergeRadius, looking at the 3x3x3 cells around the new one
+	int32 BestSlot = INDEX_NONE;
+	float BestDistSquared = MergeRadius * MergeRadius;
+
+	for (int32 x = -1; x <= 1; ++x)
+	{
+		for (int32 y = -1; y <= 1; ++y)
+		{
+			for (int32 z = -1; z <= 1; ++z)
+			{
+				for (TMultiMap<FIntVector, int32>::TConstKeyIterator It = CellToSlot.CreateConstKeyIterator(Cell + FIntVector(x, y, z)); It; ++It)
+				{
+					const FCombatDecalSlot& Slot = Slots[It.Value()];
+					if (!Slot.bActive || !Slot.Decal || Slot.Decal->GetDecalMaterial() != Material)
+						continue;
+
+					const float DistSquared = FVector::DistSquared(Slot.Location, Location);
+					if (DistSquared <= BestDistSquared)
+					{
+						BestDistSquared = DistSquared;
+						BestSlot = It.Value();
+					}
+				}
+			}
+		}
+	}
+
+	return BestSlot;
+}
+
+int32 UCombatDecalPool::AcquireSlot(float CurrentTime)
+{
+	if (FreeSlots.Num())
+		return FreeSlots.Pop(false);
+
+	// grow until we hit the cap
+	if (Slots.Num() < MaxDecals)
+		return Slots.AddDefaulted();
+
+	if (!Slots.Num())
+		return INDEX_NONE;
+
+	// Everything is in use. Look at a few slots after the cursor and reuse the one that is cheapest to lose:
+	// little lifetime left and far away from the player
+	FVector PlayerLocation = FVector::ZeroVector;
+	bool bHasPlayer = false;
+	if (UCombatSubsystem* CombatSubsystem = GetTypedOuter<UCombatSubsystem>())
+	{
+		const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
+		PlayerLocation = Snapshot.TargetLocation;
+		bHasPlayer = Snapshot.bValid;
+	}
+
+	int32 CheapestSlot = Cursor;
+	float CheapestValue = MAX_flt;
+	const int32 SearchCount = FMath::Clamp(EvictionSearch, 1, Slots.Num());
+
+	for (int32 i = 0; i != SearchCount; ++i)
+	{
+		const int32 SlotIndex = (Cursor + i) % Slots.Num();
+		const FCombatDecalSlot& Slot = Slots[SlotIndex];
+
+		const float LifeLeft = Slot.LifeTime > 0.f ? (Slot.ExpireTime - CurrentTime) / Slot.LifeTime : 0.f;
+		const float Distance = bHasPlayer ? FVector::Dist(Slot.Location, PlayerLocation) : 0.f;
+		const float Value = LifeLeft / (1.f + Distance * 0.001f);
+
+		if (Value < CheapestValue)
+		{
+			CheapestValue = Value;
+			CheapestSlot = SlotIndex;
+		}
+	}
+
+	Cursor = (Cursor + SearchCount) % Slots.Num();
+
+	DeactivateSlot(CheapestSlot);
+	FreeSlots.Remove(CheapestSlot);
+	++NumEvicted;
+
+	return CheapestSlot;
+}
+
+void UCombatDecalPool::DeactivateSlot(int32 SlotIndex)
+{
+	FCombatDecalSlot& Slot = Slots[SlotIndex];
+	if (!Slot.bActive)
+		return;
+
+	Slot.bActive = false;
+	if (Slot.Decal)
+		Slot.Decal->SetVisibility(false);
+
+	CellToSlot.RemoveSingle(Slot.Cell, SlotIndex);
+
+	FreeSlots.Add(SlotIndex);
+}
+
+FIntVector UCombatDecalPool::GetCell(const FVector& Location) const
+{
+	const float CellSize = FMath::Max(MergeRadius, 1.f);
+	return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellSize));
+}
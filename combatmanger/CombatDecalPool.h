@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "CombatDecalPool.generated.h"
+
+class UDecalComponent;
+class UMaterialInterface;
+
+USTRUCT()
+struct CPPSINNER_API FCombatDecalSlot
+{
+	GENERATED_BODY()
+
+	FCombatDecalSlot() : Decal(nullptr), Location(FVector::ZeroVector), Cell(FIntVector::ZeroValue), ExpireTime(0.f), LifeTime(0.f), bActive(false) {}
+
+	UPROPERTY()
+	UDecalComponent* Decal;
+
+	FVector Location;
+
+	// merge grid cell the decal was registered in
+	FIntVector Cell;
+
+	float ExpireTime;
+
+	float LifeTime;
+
+	bool bActive;
+};
+
+// Fixed size ring of recycled decal components for blood splats.
+// Decals close to an existing splat of the same material refresh that splat instead of adding one,
+// and when every slot is used the cheapest decal near the ring cursor (oldest / furthest from the player) is reused.
+// Owned by UCombatSubsystem, the limits are set in DefaultGame.ini.
+UCLASS(config = Game)
+class CPPSINNER_API UCombatDecalPool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UCombatDecalPool();
+
+	void SpawnDecal(UMaterialInterface* Material, const FVector& Size, const FVector& Location, const FRotator& Rotation, float LifeTime);
+
+	// hides decals that ran out of lifetime
+	void Tick(float CurrentTime);
+
+	FORCEINLINE int32 GetNumActive() const { return Slots.Num() - FreeSlots.Num(); }
+
+	FORCEINLINE int32 GetNumMerged() const { return NumMerged; }
+
+	FORCEINLINE int32 GetNumEvicted() const { return NumEvicted; }
+
+	// global cap of decal components alive at once
+	UPROPERTY(Config)
+	int32 MaxDecals;
+
+	// splats closer than this to one of the same material get merged
+	UPROPERTY(Config)
+	float MergeRadius;
+
+	// how many slots after the ring cursor are compared when we have to evict one
+	UPROPERTY(Config)
+	int32 EvictionSearch;
+
+private:
+	int32 FindMergeSlot(UMaterialInterface* Material, const FVector& Location, const FIntVector& Cell) const;
+
+	int32 AcquireSlot(float CurrentTime);
+
+	void DeactivateSlot(int32 SlotIndex);
+
+	FIntVector GetCell(const FVector& Location) const;
+
+	UPROPERTY()
+	TArray<FCombatDecalSlot> Slots;
+
+	TArray<int32> FreeSlots;
+
+	// every active slot per merge cell. Cells are MergeRadius wide, so a merge candidate is always in the same or a neighbouring cell
+	TMultiMap<FIntVector, int32> CellToSlot;
+
+	int32 Cursor;
+
+	int32 NumMerged;
+
+	int32 NumEvicted;
+};
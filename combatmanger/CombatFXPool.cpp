@@ -0,0 +1,176 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatFXPool.h"
+
+#include "NiagaraComponent.h"
+#include "NiagaraSystem.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+
+#include "CombatSubsystem.h"
+
+UCombatFXPool::UCombatFXPool() : DefaultMaxInstances(16),
+CullDistance(8000.f),
+NumCulled(0),
+NumRecycled(0),
+RecyclingComponent(nullptr)
+{
+}
+
+void UCombatFXPool::Prewarm(UNiagaraSystem* System, int32 Count)
+{
+	if (!System || !GetWorld())
+		return;
+
+	FCombatFXBucket& Bucket = Buckets.FindOrAdd(System);
+	const int32 Target = FMath::Min(Count, GetMaxInstances(System));
+
+	while (Bucket.Free.Num() + Bucket.Active.Num() < Target)
+	{
+		UNiagaraComponent* Component = CreateComponent(System);
+		if (!Component)
+			break;
+
+		Bucket.Free.Add(Component);
+	}
+}
+
+UNiagaraComponent* UCombatFXPool::SpawnAtLocation(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation)
+{
+	UNiagaraComponent* Component = Acquire(System, Location);
+	if (!Component)
+		return nullptr;
+
+	if (Component->GetAttachParent())
+		Component->DetachFromComponent(FDetachmentTransformRules::KeepWorldTransform);
+
+	Component->SetWorldLocationAndRotation(Location, Rotation);
+	Component->Activate(true);
+	return Component;
+}
+
+UNiagaraComponent* UCombatFXPool::SpawnAttached(UNiagaraSystem* System, USceneComponent* AttachTo, FName SocketName)
+{
+	if (!AttachTo)
+		return nullptr;
+
+	UNiagaraComponent* Component = Acquire(System, AttachTo->GetSocketLocation(SocketName));
+	if (!Component)
+		return nullptr;
+
+	Component->AttachToComponent(AttachTo, FAttachmentTransformRules::SnapToTargetNotIncludingScale, SocketName);
+	Component->Activate(true);
+	return Component;
+}
+
+UNiagaraComponent* UCombatFXPool::Acquire(UNiagaraSystem* System, const FVector& Location)
+{
+	if (!System || !GetWorld())
+		return nullptr;
+
+	// the player can't see it anyway
+	UCombatSubsystem* CombatSubsystem = GetTypedOuter<UCombatSubsystem>();
+	const FCombatPlayerSnapshot* Snapshot = CombatSubsystem ? &CombatSubsystem->GetPlayerSnapshot() : nullptr;
+	if (Snapshot && Snapshot->bValid && FVector::DistSquared(Snapshot->Location, Location) > CullDistance * CullDistance)
+	{
+		++NumCulled;
+		return nullptr;
+	}
+
+	FCombatFXBucket& Bucket = Buckets.FindOrAdd(System);
+
+	while (Bucket.Free.Num())
+	{
+		UNiagaraComponent* Component = Bucket.Free.Pop(false);
+		if (IsValid(Component))
+		{
+			Bucket.Active.Add(Component);
+			return Component;
+		}
+	}
+
+	// drop anything that got destroyed with the actor it was attached to
+	Bucket.Active.RemoveAllSwap([](UNiagaraComponent* Component) { return !IsValid(Component); }, false);
+
+	if (Bucket.Active.Num() < GetMaxInstances(System))
+	{
+		UNiagaraComponent* Component = CreateComponent(System);
+		if (Component)
+			Bucket.Active.Add(Component);
+		return Component;
+	}
+
+	// At the cap: reuse the instance furthest from the player, unless the new effect would be even further away
+	if (!Snapshot || !Snapshot->bValid || !Bucket.Active.Num())
+	{
+		++NumCulled;
+		return nullptr;
+	}
+
+	int32 FurthestIndex = 0;
+	float FurthestDistance = -1.f;
+	for (int32 i = 0; i != Bucket.Active.Num(); ++i)
+	{
+		const float Distance = FVector::DistSquared(Bucket.Active[i]->GetComponentLocation(), Snapshot->Location);
+		if (Distance > FurthestDistance)
+		{
+			FurthestDistance = Distance;
+			FurthestIndex = i;
+		}
+	}
+
+	if (FVector::DistSquared(Location, Snapshot->Location) >= FurthestDistance)
+	{
+		++NumCulled;
+		return nullptr;
+	}
+
+	++NumRecycled;
+	UNiagaraComponent* Component = Bucket.Active[FurthestIndex];
+
+	// DeactivateImmediate broadcasts OnSystemFinished right away, the component must stay in Active for its new effect
+	RecyclingComponent = Component;
+	Component->DeactivateImmediate();
+	RecyclingComponent = nullptr;
+
+	return Component;
+}
+
+UNiagaraComponent* UCombatFXPool::CreateComponent(UNiagaraSystem* System)
+{
+	UWorld* World = GetWorld();
+
+	UNiagaraComponent* Component = NewObject<UNiagaraComponent>(World->GetWorldSettings());
+	Component->SetAutoActivate(false);
+	Component->SetAutoDestroy(false);
+	Component->SetAsset(System);
+	Component->OnSystemFinished.AddUniqueDynamic(this, &UCombatFXPool::OnSystemFinished);
+	Component->RegisterComponentWithWorld(World);
+
+	return Component;
+}
+
+void UCombatFXPool::Release(UNiagaraComponent* Component)
+{
+	FCombatFXBucket* Bucket = Buckets.Find(Component->GetAsset());
+	if (!Bucket || Bucket->Active.RemoveSwap(Component, false) == 0)
+		return;
+
+	if (Component->GetAttachParent())
+		Component->DetachFromComponent(FDetachmentTransformRules::KeepWorldTransform);
+
+	Bucket->Free.Add(Component);
+}
+
+int32 UCombatFXPool::GetMaxInstances(UNiagaraSystem* System) const
+{
+	const int32* Found = MaxInstancesPerSystem.Find(System);
+	return Found ? *Found : DefaultMaxInstances;
+}
+
+void UCombatFXPool::OnSystemFinished(UNiagaraComponent* FinishedComponent)
+{
+	if (IsValid(FinishedComponent) && FinishedComponent != RecyclingComponent)
+		Release(FinishedComponent);
+}
@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "CombatFXPool.generated.h"
+
+class UNiagaraSystem;
+class UNiagaraComponent;
+class USceneComponent;
+
+USTRUCT()
+struct CPPSINNER_API FCombatFXBucket
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<UNiagaraComponent*> Free;
+
+	UPROPERTY()
+	TArray<UNiagaraComponent*> Active;
+};
+
+// Pool of Niagara components per system for the combat effects (blood, muzzle, weak spots).
+// Components go back to the pool by themselves once their system finishes. Every system has a cap of instances playing at once,
+// effects too far from the player are culled, and at the cap the instance furthest from the player gets reused.
+// Owned by UCombatSubsystem, the limits are set in DefaultGame.ini.
+UCLASS(config = Game)
+class CPPSINNER_API UCombatFXPool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UCombatFXPool();
+
+	// Creates components up front until the system has Count free ones (never more than its instance cap)
+	void Prewarm(UNiagaraSystem* System, int32 Count);
+
+	// Returns null if the effect got culled
+	UNiagaraComponent* SpawnAtLocation(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation);
+
+	// Snaps the effect to the socket and follows it, returns null if the effect got culled
+	UNiagaraComponent* SpawnAttached(UNiagaraSystem* System, USceneComponent* AttachTo, FName SocketName);
+
+	FORCEINLINE int32 GetNumCulled() const { return NumCulled; }
+
+	FORCEINLINE int32 GetNumRecycled() const { return NumRecycled; }
+
+	// instances of a system playing at once, unless overridden in MaxInstancesPerSystem
+	UPROPERTY(Config)
+	int32 DefaultMaxInstances;
+
+	UPROPERTY(Config)
+	TMap<UNiagaraSystem*, int32> MaxInstancesPerSystem;
+
+	// effects further than this from the player are not spawned
+	UPROPERTY(Config)
+	float CullDistance;
+
+private:
+	UNiagaraComponent* Acquire(UNiagaraSystem* System, const FVector& Location);
+
+	UNiagaraComponent* CreateComponent(UNiagaraSystem* System);
+
+	void Release(UNiagaraComponent* Component);
+
+	int32 GetMaxInstances(UNiagaraSystem* System) const;
+
+	UFUNCTION()
+	void OnSystemFinished(UNiagaraComponent* FinishedComponent);
+
+	UPROPERTY()
+	TMap<UNiagaraSystem*, FCombatFXBucket> Buckets;
+
+	int32 NumCulled;
+
+	int32 NumRecycled;
+
+	// the component Acquire is taking over from its old effect, its finish callback must not release it
+	UNiagaraComponent* RecyclingComponent;
+};
@@ -5,12 +5,21 @@
 #include "EnemyBase.h"
 #include "EnemySpawner.h"
 #include "WaveManager.h"
+#include "CombatSubsystem.h"
+#include "EnemyProjectilePool.h"
+#include "CombatFXPool.h"
+#include "EnemyPool.h"
+#include "CombatMath.h"
 
 #include "Kismet/GameplayStatics.h"
+#include "Kismet/KismetMathLibrary.h"
 #include "../Player/CPP_CharacterBase.h"
 
 #include "Components/SceneComponent.h"
 #include "Components/BoxComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SphereComponent.h"
+#include "Engine/AssetManager.h"
 
 #include "EQST_TraceTest.h"
 
@@ -23,8 +32,32 @@
 ACombatManager::ACombatManager() :maxTokens(5), 
 currTokens(maxTokens), 
 TokenRegenDelay(2.f), 
+bUseSharedTokenBudget(false),
+SharedTokenBudget(5),
 bHasTrigger(true),
 destructionTimer(45.f),
+PreloadRadius(6000.f),
+PreloadState(ECombatPreloadState::NotStarted),
+PreloadDuration(0.f),
+NumPreloadedAssets(0),
+bPreloadBlocked(false),
+PreloadStartTime(0.0),
+bPoolsPrewarmed(false),
+ProjectilesPerEnemy(3),
+FXInstancesPerSystem(4),
+SpawnQueueHead(0),
+SpawnBudgetPerFrame(4.f),
+PooledSpawnCost(1.f),
+NewSpawnCost(4.f),
+LOSTracesPerFrame(6),
+LOSRefreshInterval(0.2f),
+HighTierDistance(1500.f),
+MediumTierDistance(3500.f),
+DormantDistance(6000.f),
+SignificanceInterval(0.25f),
+TimeToSignificanceUpdate(0.f),
+SpatialCellSize(500.f),
+MaxHashedRadius(0.f),
 GridHalfSize(2000.f), 
 SpaceBetweenPoints(200.f),
 LastPlayerPos(FVector::ZeroVector), 
@@ -32,8 +65,16 @@ bSafeToTest(false),
 bLOSCalced(false),
 currentWaveID(0)
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+ 	// Only ticks once the arena is active (or has enemies of its own), see SetActorTickEnabled calls
 	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
+	// index is the EEnemyUpdateTier: tick interval, mesh tick interval, AI update interval, LOS max age, only animate when rendered
+	UpdateTiers.SetNum(static_cast<int32>(EEnemyUpdateTier::MAX));
+	UpdateTiers[static_cast<int32>(EEnemyUpdateTier::High)] = FEnemyUpdateTierSettings(0.f, 0.f, 0.f, 0.3f, false);
+	UpdateTiers[static_cast<int32>(EEnemyUpdateTier::Medium)] = FEnemyUpdateTierSettings(0.1f, 0.033f, 0.25f, 0.5f, false);
+	UpdateTiers[static_cast<int32>(EEnemyUpdateTier::Low)] = FEnemyUpdateTierSettings(0.25f, 0.066f, 0.5f, 1.f, true);
+	UpdateTiers[static_cast<int32>(EEnemyUpdateTier::Dormant)] = FEnemyUpdateTierSettings(0.f, 0.25f, 1.f, 2.f, true);
 
 	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
 
@@ -42,6 +83,11 @@ currentWaveID(0)
 		TriggerOverlap->SetCollisionProfileName(FName("OverlapAll"));
 		TriggerOverlap->InitBoxExtent(FVector(GridHalfSize, GridHalfSize, 500.f));
 
+		PreloadSphere = CreateDefaultSubobject<USphereComponent>(TEXT("PreloadSphere"));
+		PreloadSphere->SetupAttachment(RootComponent);
+		PreloadSphere->SetCollisionProfileName(FName("OverlapAll"));
+		PreloadSphere->InitSphereRadius(PreloadRadius);
+
 }
 
 // Called when the game starts or when spawned
@@ -56,16 +102,38 @@ void ACombatManager::BeginPlay()
 	GameInstanceRef = Cast<UCPP_GameInstance>(UGameplayStatics::GetGameInstance(GetWorld()));
 	
 	currTokens = maxTokens;
+
+	CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (CombatSubsystem && bUseSharedTokenBudget)
+		CombatSubsystem->RegisterSharedTokenBudget(SharedTokenBudget);
+
+	if (CombatSubsystem)
+		CombatSubsystem->RegisterCombatManager(this);
+
 	SetManagedActors();
 
+	// enemies placed in the level are already active before the arena is
+	if (ManagedEnemies.Num())
+		SetActorTickEnabled(true);
+
+	LOSTraceDelegate.BindUObject(this, &ACombatManager::OnLOSTraceDone);
+
 	TriggerOverlap->InitBoxExtent(FVector(GridHalfSize, GridHalfSize, 500.f));
 	
 	if(bHasTrigger)
-	TriggerOverlap->OnComponentBeginOverlap.AddDynamic(this, &ACombatManager::OnComponentBeginOverlap);
+	{
+		TriggerOverlap->OnComponentBeginOverlap.AddDynamic(this, &ACombatManager::OnComponentBeginOverlap);
+
+		PreloadSphere->SetSphereRadius(PreloadRadius);
+		PreloadSphere->OnComponentBeginOverlap.AddDynamic(this, &ACombatManager::OnPreloadBeginOverlap);
+	}
 	else
 	{
 		TriggerOverlap->SetCollisionProfileName(FName("NoCollision"));
 		TriggerOverlap->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+		PreloadSphere->SetCollisionProfileName(FName("NoCollision"));
+		PreloadSphere->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 	}
 	
 	if (EnvQuery)
@@ -78,6 +146,9 @@ void ACombatManager::BeginPlay()
 	
 	if (!bHasTrigger && EnvQuery)
 	{
+		// we activate right away, nothing to stream ahead of, the pools get filled once the load is done
+		SetActorTickEnabled(true);
+		FinishPreloadBlocking();
 		SpawnFodderWave();
 		SpawnWave();
 	}
@@ -85,6 +156,39 @@ void ACombatManager::BeginPlay()
 	CompletedWaves.Init(false,ManagedWaves.Num());
 }
 
+void ACombatManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Tokens still out (or waiting on the regen timer) would never reach the shared budget once we are gone
+	if (bUseSharedTokenBudget && CombatSubsystem)
+	{
+		for (int32 i = currTokens.load(); i < maxTokens; ++i)
+			CombatSubsystem->ReleaseSharedToken();
+	}
+
+	if (CombatSubsystem)
+		CombatSubsystem->UnregisterCombatManager(this);
+
+	// Sweeps still in flight keep their own copy of LOSTraceDelegate and will still call OnLOSTraceDone for as long as we are not garbage collected.
+	// Forgetting their handles here is what makes those late results a no-op
+	for (const FPendingLOSTrace& Pending : PendingLOSTraces)
+	{
+		if (AEnemyBase* Enemy = Pending.Enemy.Get())
+			Enemy->SetLOSTracePending(false);
+	}
+	PendingLOSTraces.Reset();
+
+	SpawnQueue.Reset();
+	SpawnQueueHead = 0;
+
+	if (PreloadHandle.IsValid())
+	{
+		PreloadHandle->CancelHandle();
+		PreloadHandle.Reset();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void ACombatManager::HandleQueryResult(TSharedPtr<FEnvQueryResult> result)
 {
 	if (result->IsSuccsessful())
@@ -111,6 +215,11 @@ void ACombatManager::OnComponentBeginOverlap(UPrimitiveComponent* OverlappedComp
 		if(GameInstanceRef)
 			GameInstanceRef->bPlayerInCombat = true;
 
+		SetActorTickEnabled(true);
+
+		// normally done by now (pools included), if the player got here faster than the preload we have to wait for the rest
+		FinishPreloadBlocking();
+
 		// Spawn first wave
 		SpawnWave();
 		SpawnFodderWave();
@@ -122,13 +231,26 @@ void ACombatManager::OnComponentBeginOverlap(UPrimitiveComponent* OverlappedComp
 
 }
 
+void ACombatManager::OnPreloadBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
+{
+	if (Cast<ACPP_CharacterBase>(OtherActor))
+	{
+		StartPreload();
+
+		PreloadSphere->SetCollisionProfileName(FName("NoCollision"));
+		PreloadSphere->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		PreloadSphere->OnComponentBeginOverlap.Clear();
+	}
+}
+
 void ACombatManager::ReceiveParticleData_Implementation(const TArray<FBasicParticleData>& Data, UNiagaraSystem* NiagaraSystem)
 {
-	if (BloodDecal)
+	if (BloodDecal && CombatSubsystem)
 	{
+		// recycled through the decal pool, it caps the number of splats and merges the ones landing on top of each other
 		for (const FBasicParticleData& current : Data)
 		{
-			UGameplayStatics::SpawnDecalAtLocation(GetWorld(), BloodDecal, FVector(60.f, 60.f, 60.f), current.Position, -1 * current.Velocity.Rotation(), 10.f);
+			CombatSubsystem->SpawnDecal(BloodDecal, FVector(60.f, 60.f, 60.f), current.Position, -1 * current.Velocity.Rotation(), 10.f);
 		}
 	}
 }
@@ -148,13 +270,13 @@ void ACombatManager::FreeLocationIndex(int32 LocationIndex)
 
 void ACombatManager::PerformVisibilityTest()
 {
-	ACPP_CharacterBase* PlayerRef = GetPlayer();
-	if (PlayerRef)
+	if (CombatSubsystem && CombatSubsystem->GetPlayerSnapshot().bValid)
 	{
+		const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
 		FVector itemZOffset(0.f, 0.f, 50.f);
-		FVector PlayerLoc = PlayerRef->TargetHere->GetComponentLocation();			//Create variables before the loop so we don't waste computation
+		FVector PlayerLoc = Snapshot.TargetLocation;			//Create variables before the loop so we don't waste computation
 		FCollisionQueryParams CollisionParam;
-		CollisionParam.AddIgnoredActor(PlayerRef);
+		CollisionParam.AddIgnoredActor(Snapshot.Player.Get());
 
 		//PrintTest();
 		//..////////////////LINE TRACE VERSION 
@@ -178,11 +300,10 @@ void ACombatManager::PerformVisibilityTest()
 void ACombatManager::PerformDistanceTest()
 {
 
-	ACPP_CharacterBase* PlayerRef = GetPlayer();
-	if (PlayerRef)
+	if (CombatSubsystem && CombatSubsystem->GetPlayerSnapshot().bValid)
 	{
 
-		FVector PlayerLoc = PlayerRef->TargetHere->GetComponentLocation();
+		FVector PlayerLoc = CombatSubsystem->GetPlayerSnapshot().TargetLocation;
 
 		// Find the first index of the element that is no longer a valid point due to LOS requirements not being met
 		int32 OnePastLastValid = RatedItems.IndexOfByPredicate([](const FcustomItem& item) {return item.rating < 1 ? true : false; });	
@@ -302,8 +423,7 @@ FVector ACombatManager::ProvideFreeLocationWithLOS(const FVector& currentPos, in
 {
 	if (bSafeToTest)
 	{
-		ACPP_CharacterBase* PlayerRef = GetPlayer();
-		if (PlayerRef)
+		if (CombatSubsystem && CombatSubsystem->GetPlayerSnapshot().bValid)
 		{
 			// if the player hasn't moved too much since the last test was executed we can just use the data from the previous test
 			//if (bLOSCalced && (PlayerRef->TargetHere->GetComponentLocation() - LastPlayerPos).Size() < 500.f)
@@ -396,6 +516,381 @@ void ACombatManager::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	UpdateSignificance(DeltaTime);
+
+	UpdateSpatialHash();
+
+	UpdateDistanceBands();
+
+	TickSpawnQueue();
+
+	TickBursts(DeltaTime);
+
+	TickLOS();
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// SPAWN QUEUE
+
+void ACombatManager::QueueSpawn(AEnemySpawner* Spawner, AWaveManager* Wave, int32 PositionIndex)
+{
+	if (!Spawner)
+		return;
+
+	FQueuedSpawn& Spawn = SpawnQueue.AddDefaulted_GetRef();
+	Spawn.Spawner = Spawner;
+	Spawn.Wave = Wave;
+	Spawn.PositionIndex = PositionIndex;
+
+	SetActorTickEnabled(true);
+}
+
+void ACombatManager::CancelQueuedSpawns(AWaveManager* Wave)
+{
+	for (int32 i = SpawnQueue.Num() - 1; i >= SpawnQueueHead; --i)
+	{
+		if (SpawnQueue[i].Wave == Wave)
+			SpawnQueue.RemoveAt(i, 1, false);
+	}
+}
+
+float ACombatManager::GetSpawnCost(const AEnemySpawner* Spawner) const
+{
+	UEnemyPool* EnemyPool = CombatSubsystem ? CombatSubsystem->GetEnemyPool() : nullptr;
+	if (EnemyPool && EnemyPool->GetNumFree(Spawner->GetEnemyType()) > 0)
+		return PooledSpawnCost;
+
+	return NewSpawnCost;
+}
+
+void ACombatManager::TickSpawnQueue()
+{
+	float Budget = SpawnBudgetPerFrame;
+	bool bSpawnedThisFrame = false;
+
+	while (SpawnQueueHead < SpawnQueue.Num())
+	{
+		// copy, spawning can finish a wave and queue the next one, which may grow the array
+		const FQueuedSpawn Next = SpawnQueue[SpawnQueueHead];
+		AEnemySpawner* Spawner = Next.Spawner.Get();
+
+		// always spawn at least one per frame so a budget lower than a single spawn can't stall the queue
+		const float Cost = Spawner ? GetSpawnCost(Spawner) : 0.f;
+		if (bSpawnedThisFrame && Cost > Budget)
+			break;
+
+		++SpawnQueueHead;
+		Budget -= Cost;
+
+		// the enemy plays its spawn FX in InitiateSpawn, so they show up in the order they were queued
+		AEnemyBase* Enemy = Spawner ? Spawner->SpawnUnit(Next.PositionIndex) : nullptr;
+		bSpawnedThisFrame |= Spawner != nullptr;
+
+		if (AWaveManager* Wave = Next.Wave.Get())
+			Wave->OnPendingSpawnDone(Enemy != nullptr);
+	}
+
+	if (SpawnQueueHead >= SpawnQueue.Num())
+	{
+		SpawnQueue.Reset();
+		SpawnQueueHead = 0;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// BURST FIRE
+
+void ACombatManager::QueueBurst(AEnemyBase* Enemy, int32 ShotCount, float ShotInterval, EEnemyBurstPattern Pattern)
+{
+	if (Enemy && ShotCount > 0)
+	{
+		PendingBursts.Emplace(FEnemyBurst(Enemy, ShotCount, FMath::Max(ShotInterval, 0.f), Pattern));
+		SetActorTickEnabled(true);
+	}
+}
+
+void ACombatManager::TickBursts(float DeltaTime)
+{
+	if (!PendingBursts.Num() || !CombatSubsystem)
+		return;
+
+	// without a player to aim at the bursts wait, taking their due shots now would drop them
+	const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
+	if (!Snapshot.bValid)
+		return;
+
+	// First collect every shot that is due this frame, so the aim can be solved for all of them in one go
+	DueShots.Reset();
+
+	// go backwards so finished bursts can be removed while looping
+	for (int32 i = PendingBursts.Num() - 1; i >= 0; --i)
+	{
+		FEnemyBurst& Burst = PendingBursts[i];
+		AEnemyBase* Enemy = Burst.Enemy.Get();
+
+		if (!Enemy || !Enemy->GetIsAlive())
+		{
+			PendingBursts.RemoveAtSwap(i, 1, false);
+			continue;
+		}
+
+		Burst.TimeToNextShot -= DeltaTime;
+
+		// on a long frame more than one shot of the same burst can be due
+		while (Burst.ShotsLeft > 0 && Burst.TimeToNextShot <= 0.f)
+		{
+			DueShots.Emplace(Enemy, Burst.Pattern);
+			--Burst.ShotsLeft;
+			Burst.TimeToNextShot += Burst.Interval;
+		}
+
+		if (Burst.ShotsLeft <= 0)
+			PendingBursts.RemoveAtSwap(i, 1, false);
+	}
+
+	if (!DueShots.Num())
+		return;
+
+	ShotOrigins.SetNum(DueShots.Num(), false);
+	ShotSpeeds.SetNum(DueShots.Num(), false);
+	ShotAimPoints.SetNum(DueShots.Num(), false);
+
+	for (int32 i = 0; i != DueShots.Num(); ++i)
+	{
+		ShotOrigins[i] = DueShots[i].Key->GetMuzzleLocation();
+		ShotSpeeds[i] = DueShots[i].Key->GetProjectileSpeed();
+	}
+
+	// one solve for every shot of the frame, all against the same player snapshot
+	CombatMath::SolveInterceptAimPoints(ShotOrigins, ShotSpeeds, Snapshot.TargetLocation, Snapshot.Velocity, ShotAimPoints);
+
+	for (int32 i = 0; i != DueShots.Num(); ++i)
+	{
+		const FTransform SpawnTransform(UKismetMathLibrary::FindLookAtRotation(ShotOrigins[i], ShotAimPoints[i]), ShotOrigins[i]);
+		DueShots[i].Key->FireBurstShot(DueShots[i].Value, SpawnTransform);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// LINE OF SIGHT
+
+void ACombatManager::TickLOS()
+{
+	if (!CombatSubsystem || LOSTracesPerFrame <= 0)
+		return;
+
+	const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
+	if (!Snapshot.bValid)
+		return;
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	const float PriorityDistance = GridHalfSize * 2.f;
+
+	LOSCandidates.Reset();
+	for (AEnemyBase* currentEnemy : ManagedEnemies)
+	{
+		if (!IsValid(currentEnemy) || !currentEnemy->GetIsAlive() || currentEnemy->GetIsLOSTracePending())
+			continue;
+
+		// low tier enemies accept an older LOS, refresh them at half of what they accept
+		const float RefreshInterval = FMath::Max(LOSRefreshInterval, currentEnemy->GetLOSMaxAge() * 0.5f);
+		const float Age = Now - currentEnemy->GetLOSTimeStamp();
+		if (Age < RefreshInterval)
+			continue;
+
+		// Stalest first, between equally stale enemies the closer ones and the ones holding a token (about to shoot) win
+		const float Distance = FVector::Dist(currentEnemy->GetActorLocation(), Snapshot.Location);
+		const float Priority = FMath::Min(Age / LOSRefreshInterval, 10.f)
+			+ 2.f * (1.f - FMath::Clamp(Distance / PriorityDistance, 0.f, 1.f))
+			+ (currentEnemy->GetHasToken() ? 1.f : 0.f);
+
+		LOSCandidates.Emplace(Priority, currentEnemy);
+	}
+
+	if (!LOSCandidates.Num())
+		return;
+
+	LOSCandidates.Sort([](const TPair<float, AEnemyBase*>& a, const TPair<float, AEnemyBase*>& b) { return a.Key > b.Key; });
+
+	const int32 TraceCount = FMath::Min(LOSTracesPerFrame, LOSCandidates.Num());
+	for (int32 i = 0; i != TraceCount; ++i)
+	{
+		AEnemyBase* currentEnemy = LOSCandidates[i].Value;
+
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(EnemyLOS), false, currentEnemy);
+		QueryParams.AddIgnoredActor(Snapshot.Player.Get());
+		QueryParams.AddIgnoredActor(currentEnemy->GetOwner());
+
+		// the result comes back next frame through OnLOSTraceDone
+		const FTraceHandle Handle = GetWorld()->AsyncSweepByChannel(EAsyncTraceType::Single, currentEnemy->GetMuzzleLocation(), Snapshot.TargetLocation,
+			FQuat::Identity, ECC_Visibility, FCollisionShape::MakeSphere(currentEnemy->GetLOSTraceRadius()), QueryParams,
+			FCollisionResponseParams::DefaultResponseParam, &LOSTraceDelegate);
+
+		PendingLOSTraces.Add({ Handle, currentEnemy, Now });
+		currentEnemy->SetLOSTracePending(true);
+	}
+}
+
+void ACombatManager::OnLOSTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceData)
+{
+	// not ours anymore, EndPlay dropped every pending trace
+	const int32 Index = PendingLOSTraces.IndexOfByPredicate([&TraceHandle](const FPendingLOSTrace& Pending) { return Pending.Handle == TraceHandle; });
+	if (Index == INDEX_NONE)
+		return;
+
+	const FPendingLOSTrace Pending = PendingLOSTraces[Index];
+	PendingLOSTraces.RemoveAtSwap(Index, 1, false);
+
+	// the enemy might have been destroyed while the trace was in flight, the weak pointer is the only thing telling us
+	AEnemyBase* Enemy = Pending.Enemy.Get();
+	if (!Enemy)
+		return;
+
+	const bool bBlocked = TraceData.OutHits.ContainsByPredicate([](const FHitResult& Hit) { return Hit.bBlockingHit; });
+
+	// stamped with the time the sweep started, that's the player position it was tested against
+	Enemy->SetCachedLOS(!bBlocked, Pending.StartTime);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// SIGNIFICANCE
+
+void ACombatManager::UpdateSignificance(float DeltaTime)
+{
+	TimeToSignificanceUpdate -= DeltaTime;
+	if (TimeToSignificanceUpdate > 0.f || !CombatSubsystem || UpdateTiers.Num() != static_cast<int32>(EEnemyUpdateTier::MAX))
+		return;
+
+	TimeToSignificanceUpdate = SignificanceInterval;
+
+	const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
+	if (!Snapshot.bValid)
+		return;
+
+	for (AEnemyBase* currentEnemy : ManagedEnemies)
+	{
+		if (!IsValid(currentEnemy) || !currentEnemy->GetIsAlive())
+			continue;
+
+		const float DistanceSquared = FVector::DistSquared(currentEnemy->GetActorLocation(), Snapshot.Location);
+		const bool bOnScreen = currentEnemy->WasRecentlyRendered(SignificanceInterval);
+
+		EEnemyUpdateTier Tier;
+		// an enemy holding a token is about to shoot at the player, it gets full rate wherever it is
+		if (currentEnemy->GetHasToken() || DistanceSquared < FMath::Square(HighTierDistance))
+			Tier = EEnemyUpdateTier::High;
+		else if (bOnScreen)
+			Tier = DistanceSquared < FMath::Square(MediumTierDistance) ? EEnemyUpdateTier::Medium : EEnemyUpdateTier::Low;
+		else
+			Tier = DistanceSquared < FMath::Square(DormantDistance) ? EEnemyUpdateTier::Low : EEnemyUpdateTier::Dormant;
+
+		currentEnemy->SetUpdateTier(Tier, UpdateTiers[static_cast<int32>(Tier)]);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// SPATIAL HASH
+
+void ACombatManager::UpdateSpatialHash()
+{
+	SpatialHash.Reset();
+	HashedEnemies.Reset();
+	HashedPositions.Reset();
+	HashedRadii.Reset();
+	HashedMoving.Reset();
+	HashedMeleeRange.Reset();
+	HashedPreferredMin.Reset();
+	HashedPreferredMax.Reset();
+	MaxHashedRadius = 0.f;
+
+	for (AEnemyBase* currentEnemy : ManagedEnemies)
+	{
+		if (!IsValid(currentEnemy) || !currentEnemy->GetIsAlive() || !currentEnemy->GetArchetype())
+			continue;
+
+		const int32 Index = HashedEnemies.Add(currentEnemy);
+		HashedPositions.Add(currentEnemy->GetActorLocation());
+		HashedRadii.Add(currentEnemy->GetCapsuleComponent()->GetScaledCapsuleRadius());
+		MaxHashedRadius = FMath::Max(MaxHashedRadius, HashedRadii[Index]);
+
+		// the only blackboard read of the frame for this enemy, spacing checks use the packed flag
+		HashedMoving.Add(currentEnemy->GetBlackboardProxy().GetIsMoving());
+
+		const FEnemyArchetype* EnemyArchetype = currentEnemy->GetArchetype();
+		HashedMeleeRange.Add(EnemyArchetype->MeleeRangeSquared);
+		HashedPreferredMin.Add(EnemyArchetype->PreferredMinSquared);
+		HashedPreferredMax.Add(EnemyArchetype->PreferredMaxSquared);
+
+		SpatialHash.Add(GetSpatialCell(HashedPositions[Index]), Index);
+	}
+}
+
+void ACombatManager::UpdateDistanceBands()
+{
+	if (!CombatSubsystem || !HashedEnemies.Num())
+		return;
+
+	const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
+	if (!Snapshot.bValid)
+		return;
+
+	const int32 Count = HashedEnemies.Num();
+	const FVector Target = Snapshot.TargetLocation;
+	HashedBands.SetNumUninitialized(Count, false);
+
+	// Branch free loop over the packed arrays, the compiler can vectorize it
+	const FVector* RESTRICT Positions = HashedPositions.GetData();
+	const float* RESTRICT MeleeRange = HashedMeleeRange.GetData();
+	const float* RESTRICT PreferredMin = HashedPreferredMin.GetData();
+	const float* RESTRICT PreferredMax = HashedPreferredMax.GetData();
+	uint8* RESTRICT Bands = HashedBands.GetData();
+
+	for (int32 i = 0; i != Count; ++i)
+	{
+		const float dx = Positions[i].X - Target.X;
+		const float dy = Positions[i].Y - Target.Y;
+		const float dz = Positions[i].Z - Target.Z;
+		const float DistanceSquared = dx * dx + dy * dy + dz * dz;
+
+		const uint8 bMelee = DistanceSquared <= MeleeRange[i];
+		const uint8 bPreferred = (DistanceSquared >= PreferredMin[i]) & (DistanceSquared <= PreferredMax[i]);
+
+		// 0 melee, 1 preferred, 2 bad range. Plain arithmetic on the flags so the loop stays branch free
+		Bands[i] = static_cast<uint8>((2 - bPreferred) * (1 - bMelee));
+	}
+
+	// only the enemies whose band changed touch their blackboard
+	for (int32 i = 0; i != Count; ++i)
+	{
+		HashedEnemies[i]->SetDistanceBand(Bands[i]);
+	}
+}
+
+bool ACombatManager::HasStationaryNeighbour(const AEnemyBase* Enemy, const FVector& Location, float Radius) const
+{
+	const FIntPoint Center = GetSpatialCell(Location);
+
+	// the overlap this replaces touched the other enemy's capsule, so allow for the largest capsule as well
+	const int32 Rings = FMath::Max(1, FMath::CeilToInt((Radius + MaxHashedRadius) / SpatialCellSize));
+
+	for (int32 x = -Rings; x <= Rings; ++x)
+	{
+		for (int32 y = -Rings; y <= Rings; ++y)
+		{
+			for (TMultiMap<FIntPoint, int32>::TConstKeyIterator It = SpatialHash.CreateConstKeyIterator(Center + FIntPoint(x, y)); It; ++It)
+			{
+				const int32 Index = It.Value();
+				if (HashedEnemies[Index] == Enemy || HashedMoving[Index])
+					continue;
+
+				const float MaxDistance = Radius + HashedRadii[Index];
+				if (FVector::DistSquared(HashedPositions[Index], Location) <= MaxDistance * MaxDistance)
+					return true;
+			}
+		}
+	}
+
+	return false;
 }
 
 //------------------------------------------------------------------------------------------------------------------------------
@@ -409,7 +904,8 @@ void ACombatManager::AddManagedActor(AEnemyBase* EnemyToAdd)
 {
 	if(EnemyToAdd)
 	{
-		ManagedEnemies.Add(EnemyToAdd);
+		ManagedEnemies.AddUnique(EnemyToAdd);
+		SetActorTickEnabled(true);
 	}
 }
 void ACombatManager::SetManagedActors()
@@ -420,6 +916,147 @@ void ACombatManager::SetManagedActors()
 	}
 }
 
+//------------------------------------------------------------------------------------------------------------------------------
+// PRELOAD
+
+void ACombatManager::GatherPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const
+{
+	for (const AWaveManager* currentWave : ManagedWaves)
+	{
+		if (currentWave)
+			currentWave->GatherPreloadAssets(OutAssets);
+	}
+
+	if (ManagedFodderWave)
+		ManagedFodderWave->GatherPreloadAssets(OutAssets);
+}
+
+void ACombatManager::StartPreload()
+{
+	if (PreloadState != ECombatPreloadState::NotStarted)
+		return;
+
+	PreloadState = ECombatPreloadState::Loading;
+	PreloadStartTime = FPlatformTime::Seconds();
+
+	TArray<FSoftObjectPath> AssetsToLoad;
+	GatherPreloadAssets(AssetsToLoad);
+	NumPreloadedAssets = AssetsToLoad.Num();
+
+	if (AssetsToLoad.Num())
+	{
+		PreloadHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(AssetsToLoad, FStreamableDelegate::CreateUObject(this, &ACombatManager::OnPreloadComplete));
+	}
+
+	// nothing to load, or everything was already in memory
+	if (!PreloadHandle.IsValid() || PreloadHandle->HasLoadCompleted())
+		OnPreloadComplete();
+}
+
+void ACombatManager::FinishPreloadBlocking()
+{
+	if (PreloadState == ECombatPreloadState::Ready)
+		return;
+
+	bPreloadBlocked = true;
+	StartPreload();
+
+	if (PreloadHandle.IsValid())
+		PreloadHandle->WaitUntilComplete();
+
+	// the delegate may only fire next frame, the assets are there now
+	OnPreloadComplete();
+}
+
+void ACombatManager::OnPreloadComplete()
+{
+	if (PreloadState == ECombatPreloadState::Ready)
+		return;
+
+	PreloadState = ECombatPreloadState::Ready;
+	PreloadDuration = FPlatformTime::Seconds() - PreloadStartTime;
+
+	UE_LOG(LogTemp, Log, TEXT("%s preloaded %d enemy classes in %.3fs%s"), *GetName(), NumPreloadedAssets, PreloadDuration, bPreloadBlocked ? TEXT(" (activation had to wait)") : TEXT(""));
+
+	// the enemy classes are in, pools can be filled before the player reaches the trigger
+	PrewarmPools();
+}
+
+void ACombatManager::PrewarmPools()
+{
+	if (bPoolsPrewarmed || PreloadState != ECombatPreloadState::Ready)
+		return;
+
+	if (!CombatSubsystem || !CombatSubsystem->GetProjectilePool())
+		return;
+
+	bPoolsPrewarmed = true;
+
+	// Count how many enemies of each projectile class can be alive at the same time.
+	// Waves follow each other, so that's the biggest wave per class, plus the fodder wave that runs alongside them
+	TMap<UClass*, int32> EnemiesPerProjectileClass;
+	TMap<UClass*, int32> WaveEnemiesPerProjectileClass;
+	TArray<UNiagaraSystem*> FXSystems;
+
+	auto CountWave = [this, &FXSystems](const AWaveManager* Wave, TMap<UClass*, int32>& OutCounts)
+	{
+		for (const AEnemySpawner* currentSpawner : Wave->GetManagedSpawners())
+		{
+			if (!currentSpawner || !currentSpawner->GetEnemyType())
+				continue;
+
+			const AEnemyBase* EnemyCDO = currentSpawner->GetEnemyType()->GetDefaultObject<AEnemyBase>();
+			if (!EnemyCDO)
+				continue;
+
+			if (EnemyCDO->GetProjectileClass())
+				OutCounts.FindOrAdd(EnemyCDO->GetProjectileClass()) += currentSpawner->GetSpawnCount();
+
+			EnemyCDO->GatherFXSystems(CombatSubsystem, FXSystems);
+		}
+	};
+
+	for (const AWaveManager* currentWave : ManagedWaves)
+	{
+		if (!currentWave)
+			continue;
+
+		WaveEnemiesPerProjectileClass.Reset();
+		CountWave(currentWave, WaveEnemiesPerProjectileClass);
+
+		for (const TPair<UClass*, int32>& current : WaveEnemiesPerProjectileClass)
+		{
+			int32& Count = EnemiesPerProjectileClass.FindOrAdd(current.Key);
+			Count = FMath::Max(Count, current.Value);
+		}
+	}
+
+	if (ManagedFodderWave)
+		CountWave(ManagedFodderWave, EnemiesPerProjectileClass);
+
+	for (const TPair<UClass*, int32>& current : EnemiesPerProjectileClass)
+	{
+		CombatSubsystem->GetProjectilePool()->Prewarm(current.Key, current.Value * ProjectilesPerEnemy);
+	}
+
+	if (CombatSubsystem->GetFXPool())
+	{
+		for (UNiagaraSystem* current : FXSystems)
+		{
+			CombatSubsystem->GetFXPool()->Prewarm(current, FXInstancesPerSystem);
+		}
+	}
+
+	// The first wave and the fodder wave spawn right away, the later waves find their enemies waiting in the pool.
+	// Waves follow each other so the pool only has to hold the biggest of them, dead enemies of earlier waves go back in as well.
+	// The pool spawns them a few per frame, a whole arena's worth in one frame would hitch right when the player walks in
+	for (int32 i = currentWaveID + 1; i < ManagedWaves.Num(); ++i)
+	{
+		if (ManagedWaves[i])
+			ManagedWaves[i]->PrewarmEnemies();
+	}
+}
+
 void ACombatManager::SpawnFodderWave()
 {
 	if(ManagedFodderWave)
@@ -511,12 +1148,24 @@ void ACombatManager::ClearCustomItemArr()		// Delete the dynamically allocated o
 
 bool ACombatManager::ProvideToken()
 {
-	if (currTokens > 0)
+	// Compare and swap loop on the local budget first, so two requests can never both take the last local token
+	int32 Available = currTokens.load();
+	do
 	{
-		currTokens -= 1;
-		return true;
+		if (Available <= 0)
+			return false;
 	}
-	return false;
+	while (!currTokens.compare_exchange_weak(Available, Available - 1));
+
+	// the local budget had a token, but with a shared budget the other arenas might already have used up the world wide ones
+	if (bUseSharedTokenBudget && CombatSubsystem && !CombatSubsystem->TryAcquireSharedToken())
+	{
+		// hand the local one back, the request failed as a whole
+		currTokens.fetch_add(1);
+		return false;
+	}
+
+	return true;
 }
 
 void ACombatManager::ReceiveToken()
@@ -528,7 +1177,11 @@ void ACombatManager::ReceiveToken()
 
 void ACombatManager::AddToken()
 {
-	currTokens += 1;
+	currTokens.fetch_add(1);
+
+	// the shared token regenerates with the same delay as the local one
+	if (bUseSharedTokenBudget && CombatSubsystem)
+		CombatSubsystem->ReleaseSharedToken();
 }
 
 // This gets called from WaveManager, clear up data of the dead enemy.
@@ -539,5 +1192,6 @@ void ACombatManager::ClearEnemyData(AEnemyBase* EnemyToRemove)
 		EnemyToRemove->ReleaseToken();
 		FreeLocationIndex(EnemyToRemove->LocIndex);
 		EnemyToRemove->SetCombatManager(NULL);
+		ManagedEnemies.RemoveSwap(EnemyToRemove);
 	}
 }
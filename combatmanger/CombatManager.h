@@ -12,6 +12,12 @@
 
 #include "Templates/SharedPointer.h"
 
+#include "Engine/StreamableManager.h"
+
+#include "CombatTypes.h"
+
+#include <atomic>
+
 #include "CombatManager.generated.h"
 
 class AEnemyBase;
@@ -21,6 +27,8 @@ class ACPP_CharacterBase;
 class UCPP_GameInstance;
 class AWaveManager;
 class UBoxComponent;
+class USphereComponent;
+class UCombatSubsystem;
 
 USTRUCT()
 struct CPPSINNER_API FcustomItem {
@@ -59,6 +67,15 @@ public:
 	UFUNCTION()
 	void AddManagedActor(AEnemyBase* EnemyToAdd);
 
+	// Enemies hand their bursts to the manager, one ticked queue emits the shots for every enemy
+	void QueueBurst(AEnemyBase* Enemy, int32 ShotCount, float ShotInterval, EEnemyBurstPattern Pattern);
+
+	// Spawners hand their spawns to the manager, the queue spawns them in order over several frames within SpawnBudgetPerFrame
+	void QueueSpawn(AEnemySpawner* Spawner, AWaveManager* Wave, int32 PositionIndex);
+
+	// Drops the queued spawns of a wave that is being cleared
+	void CancelQueuedSpawns(AWaveManager* Wave);
+
 protected:
 	void HandleQueryResult(TSharedPtr<FEnvQueryResult> result);
 
@@ -74,9 +91,26 @@ protected:
 	UFUNCTION()
 	void SetManagedActors();
 
+	// Fills the projectile, FX and enemy pools for every enemy type this arena will spawn, once the preload is done
+	UFUNCTION()
+	void PrewarmPools();
+
+	// Starts streaming in the enemy classes of every wave (and with them their meshes, animations, FX, sounds, projectiles and data tables)
+	UFUNCTION()
+	void StartPreload();
+
+	// Called when the arena activates, blocks on whatever the async preload hasn't loaded yet
+	void FinishPreloadBlocking();
+
+	void OnPreloadComplete();
+
+	void GatherPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const;
+
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 private:
 
 	//void GetAndAddAllSpawnedActors();
@@ -94,13 +128,41 @@ private:
 
 	FVector ReturnRandomFromPerfectScores(const FVector&, int32&);
 
-	FORCEINLINE ACPP_CharacterBase* GetPlayer() const { return Cast<ACPP_CharacterBase>(UGameplayStatics::GetPlayerPawn(GetWorld(), 0)); }
+	void TickBursts(float DeltaTime);
+
+	// Spawns from the front of the spawn queue until this frame's budget is used up, at least one per frame
+	void TickSpawnQueue();
+
+	// pooled enemies only need a reset, new ones cost a full actor spawn
+	float GetSpawnCost(const AEnemySpawner* Spawner) const;
+
+	// Starts async LOS sweeps for the enemies whose cached LOS is the most out of date, at most LOSTracesPerFrame per frame
+	void TickLOS();
+
+	void OnLOSTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceData);
+
+	// Scores every enemy (distance, on screen, token) and moves it into its update tier, every SignificanceInterval
+	void UpdateSignificance(float DeltaTime);
+
+	// Rebuilds the spatial hash of the live enemies, their positions and moving flags, once per frame
+	void UpdateSpatialHash();
+
+	// Classifies the distance band (DistanceEnum) of every hashed enemy in one pass over the packed positions and thresholds
+	void UpdateDistanceBands();
+
+	FORCEINLINE FIntPoint GetSpatialCell(const FVector& Location) const
+	{
+		return FIntPoint(FMath::FloorToInt(Location.X / SpatialCellSize), FMath::FloorToInt(Location.Y / SpatialCellSize));
+	}
 
 	UFUNCTION()
 	void AddToken();
 
 	UFUNCTION()
 		void OnComponentBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+
+	UFUNCTION()
+	void OnPreloadBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
 	
 protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Manager")
@@ -130,15 +192,116 @@ protected:
 	UPROPERTY()
 	TArray<FcustomItem> RatedItems;
 
+	UPROPERTY()
+	TArray<FEnemyBurst> PendingBursts;
+
+	// Scratch arrays for the shots that are due in the current frame, kept around so we don't allocate every tick
+	TArray<TPair<AEnemyBase*, EEnemyBurstPattern>> DueShots;
+	TArray<FVector> ShotOrigins;
+	TArray<float> ShotSpeeds;
+	TArray<FVector> ShotAimPoints;
+
+	struct FQueuedSpawn
+	{
+		TWeakObjectPtr<AEnemySpawner> Spawner;
+		TWeakObjectPtr<AWaveManager> Wave;
+		int32 PositionIndex;
+	};
+
+	// FIFO, SpawnQueueHead is the next entry to spawn, the array is reset once it has been worked off
+	TArray<FQueuedSpawn> SpawnQueue;
+	int32 SpawnQueueHead;
+
+	// Spawn cost the manager may spend per frame
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spawner")
+	float SpawnBudgetPerFrame;
+
+	// Cost of an enemy taken from the enemy pool
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spawner")
+	float PooledSpawnCost;
+
+	// Cost of an enemy that has to be spawned as a new actor
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spawner")
+	float NewSpawnCost;
+
+	// How many LOS sweeps the manager starts per frame, the rest of the enemies keep their cached value a bit longer
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOS")
+	int32 LOSTracesPerFrame;
+
+	// An enemy's LOS is traced again once it is older than this
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOS")
+	float LOSRefreshInterval;
+
+	struct FPendingLOSTrace
+	{
+		FTraceHandle Handle;
+		TWeakObjectPtr<AEnemyBase> Enemy;
+		float StartTime;
+	};
+
+	TArray<FPendingLOSTrace> PendingLOSTraces;
+
+	// Scratch array of the enemies that want a new LOS this frame, with their priority
+	TArray<TPair<float, AEnemyBase*>> LOSCandidates;
+
+	FTraceDelegate LOSTraceDelegate;
+
+	// Tick, animation, AI and LOS rates per EEnemyUpdateTier, indexed by the tier
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD", meta = (EditFixedSize))
+	TArray<FEnemyUpdateTierSettings> UpdateTiers;
+
+	// enemies closer than this always get the high tier
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float HighTierDistance;
+
+	// on screen enemies closer than this get the medium tier, further away the low tier
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float MediumTierDistance;
+
+	// off screen enemies further away than this go dormant
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float DormantDistance;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float SignificanceInterval;
+
+	float TimeToSignificanceUpdate;
+
+	// Edge length of the spatial hash cells, around the spacing radius the enemies check with keeps the lookup at 3x3 cells
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spacing")
+	float SpatialCellSize;
+
+	// Spatial hash of the enemies alive this frame, the cells hold indices into the packed arrays below
+	TMultiMap<FIntPoint, int32> SpatialHash;
+	TArray<AEnemyBase*> HashedEnemies;
+	TArray<FVector> HashedPositions;
+	TArray<float> HashedRadii;
+	TBitArray<> HashedMoving;
+	float MaxHashedRadius;
+
+	// squared band thresholds of the hashed enemies' archetypes, and the bands they got this frame
+	TArray<float> HashedMeleeRange;
+	TArray<float> HashedPreferredMin;
+	TArray<float> HashedPreferredMax;
+	TArray<uint8> HashedBands;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Manager")
 	uint8 maxTokens;
 
-	UPROPERTY(VisibleAnywhere, Category = "Manager")
-	uint8 currTokens;
+	// atomic for the same reason as the shared budget, ProvideToken takes the local and the shared token with compare and swap
+	std::atomic<int32> currTokens;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Manager")
 	float TokenRegenDelay;
 
+	// If true tokens also have to be drawn from the world wide budget, so overlapping arenas can't double the fire on the player
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Manager")
+	bool bUseSharedTokenBudget;
+
+	// Size of the world wide budget, if several managers register one the largest is used
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Manager", meta = (EditCondition = "bUseSharedTokenBudget"))
+	int32 SharedTokenBudget;
+
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Blood")
 	UMaterialInterface* BloodDecal;
 
@@ -153,6 +316,42 @@ protected:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spawner")
 	float destructionTimer;
+
+	// The player entering this sphere starts the preload, keep it well outside TriggerOverlap so the load has time to finish
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Preload")
+	USphereComponent* PreloadSphere;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Preload")
+	float PreloadRadius;
+
+	UPROPERTY(VisibleAnywhere, Category = "Preload")
+	ECombatPreloadState PreloadState;
+
+	// seconds from StartPreload until everything was loaded
+	UPROPERTY(VisibleAnywhere, Category = "Preload")
+	float PreloadDuration;
+
+	UPROPERTY(VisibleAnywhere, Category = "Preload")
+	int32 NumPreloadedAssets;
+
+	// true if the arena activated before the preload was done and had to wait for it
+	UPROPERTY(VisibleAnywhere, Category = "Preload")
+	bool bPreloadBlocked;
+
+	double PreloadStartTime;
+
+	// keeps the streamed assets loaded while the arena is around
+	TSharedPtr<FStreamableHandle> PreloadHandle;
+
+	bool bPoolsPrewarmed;
+
+	// Projectiles to have in the pool for every enemy the arena spawns at once
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Pool")
+	int32 ProjectilesPerEnemy;
+
+	// Niagara components to have in the pool for every effect the arena's enemies use
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Pool")
+	int32 FXInstancesPerSystem;
 	
 private:
 	UPROPERTY(EditAnywhere, Category = "EQS")
@@ -173,6 +372,9 @@ private:
 	UPROPERTY()
 	UCPP_GameInstance* GameInstanceRef;
 
+	UPROPERTY()
+	UCombatSubsystem* CombatSubsystem;
+
 	UPROPERTY()
 	int32 currentWaveID;
 public:	
@@ -184,6 +386,12 @@ public:
 	FVector ProvideFreeLocationWithLOS(const FVector&, int32& currentIndex);
 
 	FORCEINLINE bool GetIsSafeToTest() const { return bSafeToTest;}
+
+	FORCEINLINE ECombatPreloadState GetPreloadState() const { return PreloadState; }
+
+	// Spacing check against this manager's spatial hash: is an enemy other than Enemy standing (not moving) within Radius of Location.
+	// Only sees our own enemies, enemies ask UCombatSubsystem::HasStationaryNeighbour which goes through every manager
+	bool HasStationaryNeighbour(const AEnemyBase* Enemy, const FVector& Location, float Radius) const;
 	
 	bool ProvideToken();
 
@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatMath.h"
+
+bool CombatMath::SolveInterceptTime(const FVector& Origin, float ProjectileSpeed, const FVector& TargetLoc, const FVector& TargetVelocity, float& OutTime)
+{
+	OutTime = 0.f;
+
+	// With D = TargetLoc - Origin and V = TargetVelocity we need  (V.V - s^2) t^2 + 2 (D.V) t + D.D = 0
+	const FVector D = TargetLoc - Origin;
+	const float a = FVector::DotProduct(TargetVelocity, TargetVelocity) - ProjectileSpeed * ProjectileSpeed;
+	const float b = 2.f * FVector::DotProduct(D, TargetVelocity);
+	const float c = FVector::DotProduct(D, D);
+
+	// target moves exactly as fast as the projectile, the equation is linear
+	if (FMath::IsNearlyZero(a))
+	{
+		if (b >= 0.f)
+			return false;
+
+		OutTime = -c / b;
+		return true;
+	}
+
+	const float Discriminant = b * b - 4.f * a * c;
+	if (Discriminant < 0.f)
+		return false;
+
+	const float Root = FMath::Sqrt(Discriminant);
+	const float t1 = (-b - Root) / (2.f * a);
+	const float t2 = (-b + Root) / (2.f * a);
+
+	// we want the earliest time that is still in the future
+	const float tMin = FMath::Min(t1, t2);
+	const float tMax = FMath::Max(t1, t2);
+
+	if (tMin > 0.f)
+		OutTime = tMin;
+	else if (tMax > 0.f)
+		OutTime = tMax;
+	else
+		return false;
+
+	return true;
+}
+
+void CombatMath::SolveInterceptAimPoints(TArrayView<const FVector> Origins, TArrayView<const float> ProjectileSpeeds, const FVector& TargetLoc, const FVector& TargetVelocity, TArrayView<FVector> OutAimPoints)
+{
+	check(Origins.Num() == ProjectileSpeeds.Num() && Origins.Num() == OutAimPoints.Num());
+
+	for (int32 i = 0; i != Origins.Num(); ++i)
+	{
+		float Time;
+		if (SolveInterceptTime(Origins[i], ProjectileSpeeds[i], TargetLoc, TargetVelocity, Time))
+			OutAimPoints[i] = TargetLoc + TargetVelocity * Time;
+		else
+			OutAimPoints[i] = TargetLoc;		// no solution, shoot where the target is right now
+	}
+}
+
+void CombatMath::GenerateBulletPattern(const FEnemyBulletPattern& Pattern, const FTransform& AimTransform, float PhaseDegrees, TArray<FTransform>& OutTransforms)
+{
+	const int32 Count = FMath::Max(Pattern.Count, 1);
+	OutTransforms.SetNum(Count, false);
+
+	const FVector Origin = AimTransform.GetLocation();
+	const FQuat AimRotation = AimTransform.GetRotation();
+
+	// Ring and spiral go around the aim's yaw only, so they stay level even if the enemy aims up or down
+	const FQuat FlatAimRotation = FRotator(0.f, AimRotation.Rotator().Yaw, 0.f).Quaternion();
+
+	switch (Pattern.Type)
+	{
+	case EBulletPatternType::Spread:
+	{
+		// one bullet goes straight, the others fan out evenly over the arc
+		const float Step = Count > 1 ? Pattern.Angle / (Count - 1) : 0.f;
+		const float FirstYaw = Count > 1 ? -Pattern.Angle * 0.5f : 0.f;
+		for (int32 i = 0; i != Count; ++i)
+		{
+			const FQuat YawOffset(FVector::UpVector, FMath::DegreesToRadians(FirstYaw + Step * i));
+			OutTransforms[i] = FTransform(AimRotation * YawOffset, Origin);
+		}
+		break;
+	}
+	case EBulletPatternType::Ring:
+	case EBulletPatternType::Spiral:
+	{
+		const float Step = 360.f / Count;
+		for (int32 i = 0; i != Count; ++i)
+		{
+			const FQuat YawOffset(FVector::UpVector, FMath::DegreesToRadians(PhaseDegrees + Step * i));
+			OutTransforms[i] = FTransform(FlatAimRotation * YawOffset, Origin);
+		}
+		break;
+	}
+	case EBulletPatternType::RandomCone:
+	{
+		const FVector AimDirection = AimRotation.GetForwardVector();
+		const float HalfAngle = FMath::DegreesToRadians(Pattern.Angle);
+		for (int32 i = 0; i != Count; ++i)
+		{
+			OutTransforms[i] = FTransform(FMath::VRandCone(AimDirection, HalfAngle).ToOrientationQuat(), Origin);
+		}
+		break;
+	}
+	default:
+		for (FTransform& current : OutTransforms)
+			current = AimTransform;
+		break;
+	}
+}
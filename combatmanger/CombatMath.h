@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "CombatTypes.h"
+
+// Small math helpers shared by the combat code. Plain functions on plain data so they can be batched
+namespace CombatMath
+{
+	// Closed form lead solver. Solves |TargetLoc + TargetVelocity * t - Origin| = ProjectileSpeed * t for the smallest positive t.
+	// Returns false if the projectile can never catch the target (OutTime is 0 then).
+	CPPSINNER_API bool SolveInterceptTime(const FVector& Origin, float ProjectileSpeed, const FVector& TargetLoc, const FVector& TargetVelocity, float& OutTime);
+
+	// Solves the interception for every shooter in one pass against the same target.
+	// OutAimPoints[i] is where shot i should be aimed at, shots without a solution aim straight at TargetLoc.
+	CPPSINNER_API void SolveInterceptAimPoints(TArrayView<const FVector> Origins, TArrayView<const float> ProjectileSpeeds, const FVector& TargetLoc, const FVector& TargetVelocity, TArrayView<FVector> OutAimPoints);
+
+	// Fills OutTransforms with the spawn transform of every bullet of one volley around AimTransform.
+	// PhaseDegrees rotates Ring/Spiral patterns, the caller keeps it between volleys for spirals.
+	CPPSINNER_API void GenerateBulletPattern(const FEnemyBulletPattern& Pattern, const FTransform& AimTransform, float PhaseDegrees, TArray<FTransform>& OutTransforms);
+}
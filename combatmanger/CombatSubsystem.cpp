@@ -0,0 +1,332 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CombatSubsystem.h"
+#include "EnemyProjectilePool.h"
+#include "EnemyPool.h"
+#include "CombatDecalPool.h"
+#include "CombatAudioAggregator.h"
+#include "CombatFXPool.h"
+#include "CombatCorpseManager.h"
+#include "CombatManager.h"
+
+#include "Kismet/GameplayStatics.h"
+#include "../Player/CPP_CharacterBase.h"
+#include "Camera/CameraComponent.h"
+#include "Components/CapsuleComponent.h"
+
+UCombatSubsystem::UCombatSubsystem() : SharedTokenBudget(0),
+SharedTokensInUse(0),
+ProjectilePool(nullptr),
+EnemyPool(nullptr),
+DecalPool(nullptr),
+AudioAggregator(nullptr),
+FXPool(nullptr),
+CorpseManager(nullptr),
+ActiveBulletManager(nullptr)
+{
+}
+
+void UCombatSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	SharedTokenBudget = 0;
+	SharedTokensInUse = 0;
+
+	ProjectilePool = NewObject<UEnemyProjectilePool>(this);
+	EnemyPool = NewObject<UEnemyPool>(this);
+	DecalPool = NewObject<UCombatDecalPool>(this);
+	AudioAggregator = NewObject<UCombatAudioAggregator>(this);
+	FXPool = NewObject<UCombatFXPool>(this);
+	CorpseManager = NewObject<UCombatCorpseManager>(this);
+}
+
+void UCombatSubsystem::Deinitialize()
+{
+	ProjectilePool = nullptr;
+	EnemyPool = nullptr;
+	DecalPool = nullptr;
+	AudioAggregator = nullptr;
+	FXPool = nullptr;
+	CorpseManager = nullptr;
+	ActiveBulletManager = nullptr;
+	CombatManagers.Empty();
+	{
+		FScopeLock Lock(&SharedSnapshotLock);
+		SharedPlayerSnapshot.Reset();
+	}
+	Archetypes.Empty();
+	ArchetypeTables.Empty();
+	WeakSpotTables.Empty();
+	StaggerTables.Empty();
+	BlackboardKeys.Empty();
+
+	Super::Deinitialize();
+}
+
+void UCombatSubsystem::Tick(float DeltaTime)
+{
+	// refresh the cached player data once per frame, everyone else reads it from here
+	CapturePlayerSnapshot();
+
+	if (ProjectilePool)
+		ProjectilePool->Tick(GetWorld()->GetTimeSeconds());
+
+	if (EnemyPool)
+		EnemyPool->Tick();
+
+	if (DecalPool)
+		DecalPool->Tick(GetWorld()->GetTimeSeconds());
+
+	if (AudioAggregator)
+		AudioAggregator->Tick();
+
+	if (CorpseManager)
+		CorpseManager->Tick(GetWorld()->GetTimeSeconds());
+}
+
+bool UCombatSubsystem::IsTickable() const
+{
+	// the class default object doesn't belong to a world
+	return !IsTemplate() && GetWorld() && GetWorld()->IsGameWorld();
+}
+
+TStatId UCombatSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCombatSubsystem, STATGROUP_Tickables);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// SHARED TOKEN BUDGET
+
+void UCombatSubsystem::RegisterSharedTokenBudget(int32 Budget)
+{
+	// Only ever grow the budget, a second arena asking for less shouldn't starve the first one
+	int32 Current = SharedTokenBudget.load();
+	while (Budget > Current && !SharedTokenBudget.compare_exchange_weak(Current, Budget))
+	{
+		// Current got refreshed by the failed exchange, try again
+	}
+}
+
+bool UCombatSubsystem::TryAcquireSharedToken()
+{
+	// Compare and swap loop, so two requests can never both take the last token
+	int32 InUse = SharedTokensInUse.load();
+	while (InUse < SharedTokenBudget.load())
+	{
+		if (SharedTokensInUse.compare_exchange_weak(InUse, InUse + 1))
+			return true;
+	}
+	return false;
+}
+
+void UCombatSubsystem::ReleaseSharedToken()
+{
+	int32 InUse = SharedTokensInUse.load();
+	while (InUse > 0)
+	{
+		if (SharedTokensInUse.compare_exchange_weak(InUse, InUse - 1))
+			return;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// PLAYER SNAPSHOT
+
+const FCombatPlayerSnapshot& UCombatSubsystem::GetPlayerSnapshot()
+{
+	if (PlayerSnapshot.FrameNumber != GFrameCounter)
+		CapturePlayerSnapshot();
+
+	return PlayerSnapshot;
+}
+
+void UCombatSubsystem::CapturePlayerSnapshot()
+{
+	PlayerSnapshot.FrameNumber = GFrameCounter;
+
+	ACPP_CharacterBase* Player = Cast<ACPP_CharacterBase>(UGameplayStatics::GetPlayerPawn(GetWorld(), 0));
+	if (Player && Player->TargetHere)
+	{
+		PlayerSnapshot.Location = Player->GetActorLocation();
+		PlayerSnapshot.TargetLocation = Player->TargetHere->GetComponentLocation();
+		PlayerSnapshot.Velocity = Player->GetVelocity();
+		PlayerSnapshot.ViewDirection = Player->GetFirstPersonCameraComponent() ? Player->GetFirstPersonCameraComponent()->GetForwardVector() : Player->GetActorForwardVector();
+
+		const UCapsuleComponent* Capsule = Player->GetCapsuleComponent();
+		PlayerSnapshot.CapsuleLocation = Capsule->GetComponentLocation();
+		PlayerSnapshot.CapsuleUp = Capsule->GetUpVector();
+		PlayerSnapshot.CapsuleRadius = Capsule->GetScaledCapsuleRadius();
+		PlayerSnapshot.CapsuleHalfHeight = Capsule->GetScaledCapsuleHalfHeight_WithoutHemisphere();
+
+		PlayerSnapshot.MovementRating = Player->GetMovementRating();
+		PlayerSnapshot.bIsMoving = Player->GetIsCharacterMoving();
+		PlayerSnapshot.Player = Player;
+		PlayerSnapshot.bValid = true;
+	}
+	else
+	{
+		PlayerSnapshot.Player = nullptr;
+		PlayerSnapshot.bValid = false;
+	}
+
+	TSharedPtr<const FCombatPlayerSnapshot, ESPMode::ThreadSafe> Published = MakeShared<const FCombatPlayerSnapshot, ESPMode::ThreadSafe>(PlayerSnapshot);
+
+	FScopeLock Lock(&SharedSnapshotLock);
+	SharedPlayerSnapshot = Published;
+}
+
+TSharedPtr<const FCombatPlayerSnapshot, ESPMode::ThreadSafe> UCombatSubsystem::GetSharedPlayerSnapshot() const
+{
+	FScopeLock Lock(&SharedSnapshotLock);
+	return SharedPlayerSnapshot;
+}
+
+bool UCombatSubsystem::IsPlayerWithin(const FVector& Location, float Radius)
+{
+	const FCombatPlayerSnapshot& Snapshot = GetPlayerSnapshot();
+	if (!Snapshot.bValid)
+		return false;
+
+	// distance to the capsule's segment, grown by the capsule radius
+	const FVector SegmentOffset = Snapshot.CapsuleUp * Snapshot.CapsuleHalfHeight;
+	const float TouchRadius = Radius + Snapshot.CapsuleRadius;
+	return FMath::PointDistToSegmentSquared(Location, Snapshot.CapsuleLocation - SegmentOffset, Snapshot.CapsuleLocation + SegmentOffset) <= TouchRadius * TouchRadius;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// SPACING
+
+void UCombatSubsystem::RegisterCombatManager(ACombatManager* CombatManager)
+{
+	CombatManagers.AddUnique(CombatManager);
+}
+
+void UCombatSubsystem::UnregisterCombatManager(ACombatManager* CombatManager)
+{
+	CombatManagers.RemoveSwap(CombatManager);
+}
+
+bool UCombatSubsystem::HasStationaryNeighbour(const AEnemyBase* Enemy, const FVector& Location, float Radius) const
+{
+	// managers that ticked before the caller's one already have this frame's hash, the others still hold last frame's
+	for (const ACombatManager* CombatManager : CombatManagers)
+	{
+		if (CombatManager && CombatManager->HasStationaryNeighbour(Enemy, Location, Radius))
+			return true;
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// ENEMY LOOKUP TABLES
+
+TSharedPtr<const FEnemyArchetype> UCombatSubsystem::GetArchetype(UDataTable* DataTable, EEnemyType EnemyType)
+{
+	const TPair<TObjectKey<UDataTable>, EEnemyType> Key(DataTable, EnemyType);
+
+	if (const TSharedPtr<const FEnemyArchetype>* Found = Archetypes.Find(Key))
+		return *Found;
+
+	if (DataTable)
+		ArchetypeTables.AddUnique(DataTable);
+
+	TSharedPtr<const FEnemyArchetype> Archetype = FEnemyArchetype::Build(DataTable, EnemyType);
+	Archetypes.Add(Key, Archetype);
+	return Archetype;
+}
+
+TSharedPtr<const FEnemyWeakSpotTable> UCombatSubsystem::GetWeakSpotTable(const UDataTable* DataTable, EEnemyType EnemyType, const USkeletalMesh* Mesh, const TArray<FWeakSpot>& WeakSpots)
+{
+	const FWeakSpotTableKey Key{ DataTable, EnemyType, Mesh };
+
+	if (const TSharedPtr<const FEnemyWeakSpotTable>* Found = WeakSpotTables.Find(Key))
+		return *Found;
+
+	TSharedPtr<const FEnemyWeakSpotTable> Table = FEnemyWeakSpotTable::Build(Mesh, WeakSpots);
+	WeakSpotTables.Add(Key, Table);
+	return Table;
+}
+
+TSharedPtr<const FEnemyStaggerTable> UCombatSubsystem::GetStaggerTable(const UClass* EnemyClass, const USkeletalMesh* Mesh, const TMap<FName, uint8>& RegionRoots)
+{
+	const TPair<TObjectKey<UClass>, TObjectKey<USkeletalMesh>> Key(EnemyClass, Mesh);
+
+	if (const TSharedPtr<const FEnemyStaggerTable>* Found = StaggerTables.Find(Key))
+		return *Found;
+
+	TSharedPtr<const FEnemyStaggerTable> Table = FEnemyStaggerTable::Build(Mesh, RegionRoots);
+	StaggerTables.Add(Key, Table);
+	return Table;
+}
+
+TSharedPtr<const FEnemyBlackboardKeys> UCombatSubsystem::GetBlackboardKeys(const UBlackboardData* BlackboardAsset)
+{
+	const TObjectKey<UBlackboardData> Key(BlackboardAsset);
+
+	if (const TSharedPtr<const FEnemyBlackboardKeys>* Found = BlackboardKeys.Find(Key))
+		return *Found;
+
+	TSharedPtr<const FEnemyBlackboardKeys> Keys = FEnemyBlackboardKeys::Build(BlackboardAsset);
+	BlackboardKeys.Add(Key, Keys);
+	return Keys;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// POOLS
+
+void UCombatSubsystem::SpawnDecal(UMaterialInterface* Material, const FVector& Size, const FVector& Location, const FRotator& Rotation, float LifeTime)
+{
+	if (DecalPool)
+		DecalPool->SpawnDecal(Material, Size, Location, Rotation, LifeTime);
+}
+
+void UCombatSubsystem::ReleaseProjectile(AEnemyProjectileBase* ProjectileToRelease)
+{
+	if (ProjectilePool)
+		ProjectilePool->Release(ProjectileToRelease);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// AUDIO
+
+void UCombatSubsystem::PlayCombatSound(USoundBase* Sound, const FVector& Location, ECombatAudioCategory Category, USceneComponent* AttachTo, FName SocketName)
+{
+	if (AudioAggregator)
+		AudioAggregator->PlaySound(Sound, Location, Category, AttachTo, SocketName);
+}
+
+FCombatAudioStats UCombatSubsystem::GetCombatAudioStats() const
+{
+	return AudioAggregator ? AudioAggregator->GetStats() : FCombatAudioStats();
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// FX
+
+UNiagaraComponent* UCombatSubsystem::SpawnCombatFX(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation)
+{
+	return FXPool ? FXPool->SpawnAtLocation(System, Location, Rotation) : nullptr;
+}
+
+UNiagaraComponent* UCombatSubsystem::SpawnCombatFXAttached(UNiagaraSystem* System, USceneComponent* AttachTo, FName SocketName)
+{
+	return FXPool ? FXPool->SpawnAttached(System, AttachTo, SocketName) : nullptr;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------
+// SIMULATED BULLETS
+
+void UCombatSubsystem::RegisterBulletManager(AEnemyBulletManager* BulletManager)
+{
+	ActiveBulletManager = BulletManager;
+}
+
+void UCombatSubsystem::UnregisterBulletManager(AEnemyBulletManager* BulletManager)
+{
+	if (ActiveBulletManager == BulletManager)
+		ActiveBulletManager = nullptr;
+}
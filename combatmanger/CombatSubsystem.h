@@ -0,0 +1,232 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "CombatTypes.h"
+#include "EnemyData.h"
+#include "EnemyBoneTables.h"
+#include "EnemyArchetype.h"
+#include "EnemyBlackboardProxy.h"
+
+#include <atomic>
+
+#include "CombatSubsystem.generated.h"
+
+class UEnemyProjectilePool;
+class UEnemyPool;
+class UCombatDecalPool;
+class UCombatAudioAggregator;
+class UCombatFXPool;
+class UCombatCorpseManager;
+class UNiagaraSystem;
+class UNiagaraComponent;
+class USoundBase;
+class USceneComponent;
+class AEnemyProjectileBase;
+class AEnemyBulletManager;
+class UDataTable;
+class USkeletalMesh;
+class UBlackboardData;
+class ACombatManager;
+class AEnemyBase;
+
+// World level state shared by every ACombatManager in the level.
+// Arenas that overlap (fodder wave + set piece next to it) would otherwise hand out their tokens independently
+UCLASS()
+class CPPSINNER_API UCombatSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UCombatSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject, keeps the world level services (decal lifetimes, ...) up to date
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// SHARED TOKEN BUDGET
+	// The counters are atomic so token requests stay correct even if they are moved off the game thread.
+
+	// Called by every manager that opts into the shared budget. The largest requested budget wins.
+	void RegisterSharedTokenBudget(int32 Budget);
+
+	// Tries to take one token from the shared budget, returns false if there is none left (or no manager registered a budget)
+	bool TryAcquireSharedToken();
+
+	// Gives one token back to the shared budget
+	void ReleaseSharedToken();
+
+	FORCEINLINE int32 GetSharedTokensInUse() const { return SharedTokensInUse.load(); }
+
+	FORCEINLINE int32 GetSharedTokenBudget() const { return SharedTokenBudget.load(); }
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// PLAYER SNAPSHOT
+
+	// Player data for the current frame, captured by the first caller of the frame and read by everyone else
+	const FCombatPlayerSnapshot& GetPlayerSnapshot();
+
+	// The same snapshot as an immutable shared copy, safe to hold on to and read from worker threads.
+	// A new copy is published every time the snapshot is captured
+	TSharedPtr<const FCombatPlayerSnapshot, ESPMode::ThreadSafe> GetSharedPlayerSnapshot() const;
+
+	// Proximity service, "does a sphere of Radius at Location touch the player" answered from the cached player capsule with a squared distance test.
+	// Same result as the sphere overlap against the player's capsule it replaces
+	UFUNCTION(BlueprintCallable, Category = "Combat")
+	bool IsPlayerWithin(const FVector& Location, float Radius);
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// SPACING
+	// Every manager hashes its own enemies, the spacing check goes through all of them so enemies of neighbouring arenas still count.
+
+	void RegisterCombatManager(ACombatManager* CombatManager);
+
+	void UnregisterCombatManager(ACombatManager* CombatManager);
+
+	// is an enemy other than Enemy standing (not moving) within Radius of Location, same answer as the ECC_Enemy overlap for managed enemies
+	bool HasStationaryNeighbour(const AEnemyBase* Enemy, const FVector& Location, float Radius) const;
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// ENEMY LOOKUP TABLES
+
+	// Shared archetype for a data table + enemy type, the row is looked up only the first time
+	TSharedPtr<const FEnemyArchetype> GetArchetype(UDataTable* DataTable, EEnemyType EnemyType);
+
+	// Weak spot table for an archetype (data table + enemy type) on a mesh, built the first time it's asked for
+	TSharedPtr<const FEnemyWeakSpotTable> GetWeakSpotTable(const UDataTable* DataTable, EEnemyType EnemyType, const USkeletalMesh* Mesh, const TArray<FWeakSpot>& WeakSpots);
+
+	// Stagger region table for an enemy class on a mesh, the region roots are class defaults so the class is part of the key
+	TSharedPtr<const FEnemyStaggerTable> GetStaggerTable(const UClass* EnemyClass, const USkeletalMesh* Mesh, const TMap<FName, uint8>& RegionRoots);
+
+	// Enemy blackboard key IDs for a blackboard asset, resolved the first time it's asked for
+	TSharedPtr<const FEnemyBlackboardKeys> GetBlackboardKeys(const UBlackboardData* BlackboardAsset);
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// POOLS
+
+	FORCEINLINE UEnemyProjectilePool* GetProjectilePool() const { return ProjectilePool; }
+
+	FORCEINLINE UEnemyPool* GetEnemyPool() const { return EnemyPool; }
+
+	FORCEINLINE UCombatDecalPool* GetDecalPool() const { return DecalPool; }
+
+	// Blood splats go through the decal pool instead of spawning a decal component each
+	void SpawnDecal(UMaterialInterface* Material, const FVector& Size, const FVector& Location, const FRotator& Rotation, float LifeTime);
+
+	// Enemy projectiles call this on impact instead of Destroy. Pooled ones go back to their pool, any other projectile is destroyed
+	UFUNCTION(BlueprintCallable, Category = "Combat|Pool")
+	void ReleaseProjectile(AEnemyProjectileBase* ProjectileToRelease);
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// AUDIO
+
+	// Combat sounds go through the aggregator, same cue events close together become one voice and every category has a voice budget
+	void PlayCombatSound(USoundBase* Sound, const FVector& Location, ECombatAudioCategory Category, USceneComponent* AttachTo = nullptr, FName SocketName = NAME_None);
+
+	// played / merged / dropped counts of the combat audio
+	UFUNCTION(BlueprintCallable, Category = "Combat|Audio")
+	FCombatAudioStats GetCombatAudioStats() const;
+
+	FORCEINLINE UCombatAudioAggregator* GetAudioAggregator() const { return AudioAggregator; }
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// FX
+
+	FORCEINLINE UCombatFXPool* GetFXPool() const { return FXPool; }
+
+	// Blood, muzzle and weak spot effects come from the FX pool, null if the effect got culled
+	UNiagaraComponent* SpawnCombatFX(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation);
+
+	UNiagaraComponent* SpawnCombatFXAttached(UNiagaraSystem* System, USceneComponent* AttachTo, FName SocketName);
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// CORPSES
+
+	// Caps the simulating ragdolls and the corpses lying around, dead enemies register with it
+	FORCEINLINE UCombatCorpseManager* GetCorpseManager() const { return CorpseManager; }
+
+	//------------------------------------------------------------------------------------------------------------------------------
+	// SIMULATED BULLETS
+
+	void RegisterBulletManager(AEnemyBulletManager* BulletManager);
+
+	void UnregisterBulletManager(AEnemyBulletManager* BulletManager);
+
+	// null if the level has no bullet manager, enemies fall back to projectile actors then
+	FORCEINLINE AEnemyBulletManager* GetBulletManager() const { return ActiveBulletManager; }
+
+private:
+	void CapturePlayerSnapshot();
+
+	UPROPERTY()
+	FCombatPlayerSnapshot PlayerSnapshot;
+
+	TSharedPtr<const FCombatPlayerSnapshot, ESPMode::ThreadSafe> SharedPlayerSnapshot;
+
+	// guards SharedPlayerSnapshot, the pointer swap isn't atomic
+	mutable FCriticalSection SharedSnapshotLock;
+
+	struct FWeakSpotTableKey
+	{
+		TObjectKey<UDataTable> DataTable;
+		EEnemyType EnemyType;
+		TObjectKey<USkeletalMesh> Mesh;
+
+		bool operator==(const FWeakSpotTableKey& Other) const { return DataTable == Other.DataTable && EnemyType == Other.EnemyType && Mesh == Other.Mesh; }
+		friend uint32 GetTypeHash(const FWeakSpotTableKey& Key) { return HashCombine(HashCombine(GetTypeHash(Key.DataTable), GetTypeHash(static_cast<uint8>(Key.EnemyType))), GetTypeHash(Key.Mesh)); }
+	};
+
+	TMap<TPair<TObjectKey<UDataTable>, EEnemyType>, TSharedPtr<const FEnemyArchetype>> Archetypes;
+
+	// archetypes point into these tables, keep them loaded as long as we hand out their rows
+	UPROPERTY()
+	TArray<UDataTable*> ArchetypeTables;
+
+	TMap<FWeakSpotTableKey, TSharedPtr<const FEnemyWeakSpotTable>> WeakSpotTables;
+
+	TMap<TPair<TObjectKey<UClass>, TObjectKey<USkeletalMesh>>, TSharedPtr<const FEnemyStaggerTable>> StaggerTables;
+
+	TMap<TObjectKey<UBlackboardData>, TSharedPtr<const FEnemyBlackboardKeys>> BlackboardKeys;
+
+	UPROPERTY()
+	UEnemyProjectilePool* ProjectilePool;
+
+	UPROPERTY()
+	UEnemyPool* EnemyPool;
+
+	UPROPERTY()
+	UCombatDecalPool* DecalPool;
+
+	UPROPERTY()
+	UCombatAudioAggregator* AudioAggregator;
+
+	UPROPERTY()
+	UCombatFXPool* FXPool;
+
+	UPROPERTY()
+	UCombatCorpseManager* CorpseManager;
+
+	UPROPERTY()
+	AEnemyBulletManager* ActiveBulletManager;
+
+	UPROPERTY()
+	TArray<ACombatManager*> CombatManagers;
+
+	std::atomic<int32> SharedTokenBudget;
+
+	std::atomic<int32> SharedTokensInUse;
+};
@@ -0,0 +1,240 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "CombatTypes.generated.h"
+
+class AEnemyBase;
+
+// What an enemy fires for every shot of a burst
+UENUM(BlueprintType)
+enum class EEnemyBurstPattern : uint8
+{
+	Single		UMETA(DisplayName = "Single"),
+	Triple		UMETA(DisplayName = "Triple"),
+	Volley		UMETA(DisplayName = "Volley")		// the enemy's VolleyPattern
+};
+
+// Shape of a volley, see CombatMath::GenerateBulletPattern
+UENUM(BlueprintType)
+enum class EBulletPatternType : uint8
+{
+	Spread		UMETA(DisplayName = "Spread"),		// fan in the aim's yaw, Angle is the whole arc
+	Ring		UMETA(DisplayName = "Ring"),		// evenly around the enemy in the aim's horizontal plane
+	Spiral		UMETA(DisplayName = "Spiral"),		// ring that rotates by SpiralStep every volley
+	RandomCone	UMETA(DisplayName = "RandomCone")	// random directions in a cone, Angle is the half angle
+};
+
+USTRUCT(BlueprintType)
+struct CPPSINNER_API FEnemyBulletPattern
+{
+	GENERATED_BODY()
+
+	FEnemyBulletPattern() : Type(EBulletPatternType::Spread), Count(1), Angle(0.f), SpiralStep(15.f) {}
+	FEnemyBulletPattern(EBulletPatternType InType, int32 InCount, float InAngle, float InSpiralStep = 15.f) :
+	Type(InType), Count(InCount), Angle(InAngle), SpiralStep(InSpiralStep) {}
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Pattern")
+	EBulletPatternType Type;
+
+	// bullets per volley
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Pattern", meta = (ClampMin = "1"))
+	int32 Count;
+
+	// degrees, spread arc or cone half angle depending on Type
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Pattern")
+	float Angle;
+
+	// degrees the spiral turns between volleys
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Pattern")
+	float SpiralStep;
+};
+
+// One burst queued on the combat manager, the manager ticks all of them in one place instead of every shot owning a timer
+USTRUCT()
+struct CPPSINNER_API FEnemyBurst
+{
+	GENERATED_BODY()
+
+	FEnemyBurst() : ShotsLeft(0), Interval(0.f), TimeToNextShot(0.f), Pattern(EEnemyBurstPattern::Single) {}
+	FEnemyBurst(AEnemyBase* InEnemy, int32 InShots, float InInterval, EEnemyBurstPattern InPattern) :
+	Enemy(InEnemy), ShotsLeft(InShots), Interval(InInterval), TimeToNextShot(0.f), Pattern(InPattern) {}
+
+	UPROPERTY()
+	TWeakObjectPtr<AEnemyBase> Enemy;
+
+	int32 ShotsLeft;
+
+	float Interval;
+
+	// counts down, the shot is fired once it reaches zero. The first shot goes out on the next manager tick
+	float TimeToNextShot;
+
+	EEnemyBurstPattern Pattern;
+};
+
+// Counters kept by the combat pools, to see in a fight how often the pool could serve a request
+USTRUCT(BlueprintType)
+struct CPPSINNER_API FCombatPoolStats
+{
+	GENERATED_BODY()
+
+	FCombatPoolStats() : Hits(0), Misses(0), Releases(0), Prewarmed(0), Lost(0) {}
+
+	// requests served by an object that was already in the pool
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Pool")
+	int32 Hits;
+
+	// requests that had to spawn a new object
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Pool")
+	int32 Misses;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Pool")
+	int32 Releases;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Pool")
+	int32 Prewarmed;
+
+	// objects destroyed by their own code while they were out of the pool, the pool has to spawn them again
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Pool")
+	int32 Lost;
+};
+
+// Player data captured once per frame and shared by all combat code, so the hot paths don't each cast and fetch the player
+USTRUCT(BlueprintType)
+struct CPPSINNER_API FCombatPlayerSnapshot
+{
+	GENERATED_BODY()
+
+	FCombatPlayerSnapshot() : Location(FVector::ZeroVector), TargetLocation(FVector::ZeroVector), Velocity(FVector::ZeroVector), ViewDirection(FVector::ForwardVector),
+		CapsuleLocation(FVector::ZeroVector), CapsuleUp(FVector::UpVector), CapsuleRadius(0.f), CapsuleHalfHeight(0.f),
+		MovementRating(0.f), bIsMoving(false), bValid(false), FrameNumber(0) {}
+
+	// actor location of the player
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	FVector Location;
+
+	// location of the player's TargetHere component, what enemies aim at
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	FVector TargetLocation;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	FVector Velocity;
+
+	// forward vector of the first person camera
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	FVector ViewDirection;
+
+	// the player's capsule, for hit tests that don't go through the physics scene (simulated bullets)
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	FVector CapsuleLocation;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	FVector CapsuleUp;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	float CapsuleRadius;
+
+	// scaled half height without the hemispheres, the capsule's segment goes this far up and down from CapsuleLocation
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	float CapsuleHalfHeight;
+
+	// the player's movement rating, how similar the current movement is to the previous one
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	float MovementRating;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	bool bIsMoving;
+
+	// false if there was no player pawn when the snapshot was taken
+	UPROPERTY(BlueprintReadOnly, Category = "Player")
+	bool bValid;
+
+	uint64 FrameNumber;
+
+	// for ignoring the player in traces, only dereference on the game thread
+	TWeakObjectPtr<AActor> Player;
+};
+
+// Categories of combat sounds, every category has its own voice budget in the audio aggregator
+UENUM(BlueprintType)
+enum class ECombatAudioCategory : uint8
+{
+	Impact		UMETA(DisplayName = "Impact"),
+	WeakSpot	UMETA(DisplayName = "WeakSpot"),
+	Death		UMETA(DisplayName = "Death"),
+	Spawn		UMETA(DisplayName = "Spawn"),
+	MAX			UMETA(Hidden)
+};
+
+USTRUCT(BlueprintType)
+struct CPPSINNER_API FCombatAudioStats
+{
+	GENERATED_BODY()
+
+	FCombatAudioStats() : Played(0), Merged(0), Dropped(0) {}
+
+	// sounds that got their own voice
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Audio")
+	int32 Played;
+
+	// sounds folded into a voice that was already playing the same cue nearby
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Audio")
+	int32 Merged;
+
+	// sounds dropped because their category was out of voices
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Audio")
+	int32 Dropped;
+};
+
+// Where an arena is with streaming in the enemy classes of its waves
+UENUM(BlueprintType)
+enum class ECombatPreloadState : uint8
+{
+	NotStarted	UMETA(DisplayName = "NotStarted"),
+	Loading		UMETA(DisplayName = "Loading"),
+	Ready		UMETA(DisplayName = "Ready")
+};
+
+// How much of the frame an enemy gets, picked by the combat manager from distance, visibility and token
+UENUM(BlueprintType)
+enum class EEnemyUpdateTier : uint8
+{
+	High		UMETA(DisplayName = "High"),
+	Medium		UMETA(DisplayName = "Medium"),
+	Low			UMETA(DisplayName = "Low"),
+	Dormant		UMETA(DisplayName = "Dormant"),
+	MAX			UMETA(Hidden)
+};
+
+USTRUCT(BlueprintType)
+struct CPPSINNER_API FEnemyUpdateTierSettings
+{
+	GENERATED_BODY()
+
+	FEnemyUpdateTierSettings() : TickInterval(0.f), MeshTickInterval(0.f), AIUpdateInterval(0.f), LOSMaxAge(0.3f), bOnlyAnimateWhenRendered(false) {}
+
+	FEnemyUpdateTierSettings(float InTickInterval, float InMeshTickInterval, float InAIUpdateInterval, float InLOSMaxAge, bool bInOnlyAnimateWhenRendered)
+		: TickInterval(InTickInterval), MeshTickInterval(InMeshTickInterval), AIUpdateInterval(InAIUpdateInterval), LOSMaxAge(InLOSMaxAge), bOnlyAnimateWhenRendered(bInOnlyAnimateWhenRendered) {}
+
+	// actor tick interval, ignored for Dormant enemies which don't tick at all
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float TickInterval;
+
+	// skeletal mesh (animation) tick interval
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float MeshTickInterval;
+
+	// minimum time between the blackboard updates the BT services ask for (GetEnemyInfo, UpdateLOS, UpdateIsValidPosition)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float AIUpdateInterval;
+
+	// how old the cached LOS may get before the enemy traces itself
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	float LOSMaxAge;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LOD")
+	bool bOnlyAnimateWhenRendered;
+};
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyArchetype.h"
+
+#include "Engine/DataTable.h"
+
+FName FEnemyArchetype::GetRowName(EEnemyType EnemyType)
+{
+	switch (EnemyType)
+	{
+	case EEnemyType::small: return FName("small");
+	case EEnemyType::medium: return FName("medium");
+	case EEnemyType::large: return FName("large");
+	default: return NAME_None;
+	}
+}
+
+const FEnemyData& FEnemyArchetype::GetDefaultRow()
+{
+	static const FEnemyData DefaultRow;
+	return DefaultRow;
+}
+
+TSharedRef<FEnemyArchetype> FEnemyArchetype::Build(const UDataTable* DataTable, EEnemyType EnemyType)
+{
+	TSharedRef<FEnemyArchetype> Archetype = MakeShared<FEnemyArchetype>();
+
+	if (DataTable)
+	{
+		if (const FEnemyData* FoundRow = DataTable->FindRow<FEnemyData>(GetRowName(EnemyType), TEXT("FEnemyArchetype::Build")))
+			Archetype->Row = FoundRow;
+	}
+
+	Archetype->MeleeRangeSquared = FMath::Square(Archetype->Row->MeleeAttackRange);
+	Archetype->PreferredMinSquared = FMath::Square(FMath::Max(Archetype->Row->PreferredDistance - PreferredDistanceVariance, 0.f));
+	Archetype->PreferredMaxSquared = FMath::Square(Archetype->Row->PreferredDistance + PreferredDistanceVariance);
+
+	// the weak spot activation is stored in a 32 bit mask per enemy
+	ensureMsgf(Archetype->Row->WeakSpots.Num() <= 32, TEXT("Enemy archetypes support up to 32 weak spots"));
+
+	return Archetype;
+}
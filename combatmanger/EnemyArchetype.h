@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "EnemyData.h"
+
+class UDataTable;
+
+// Immutable data shared by every enemy of the same data table + EEnemyType.
+// Enemies used to deep copy their whole FEnemyData row (weak spots, particles, sounds) only to flip bHasBeenActivated,
+// the per instance part is now a bitmask on the enemy and the row is read from here.
+struct CPPSINNER_API FEnemyArchetype
+{
+	FEnemyArchetype() : Row(&GetDefaultRow()), MeleeRangeSquared(0.f), PreferredMinSquared(0.f), PreferredMaxSquared(0.f) {}
+
+	// points at the row inside the data table (or at the default row), never null
+	const FEnemyData* Row;
+
+	// Squared distance band thresholds, precomputed from the row
+	float MeleeRangeSquared;
+	float PreferredMinSquared;
+	float PreferredMaxSquared;
+
+	// how far an enemy may be off its preferred distance and still count as being at it
+	static constexpr float PreferredDistanceVariance = 1000.f;
+
+	// DistanceEnum band for a squared distance to the player:
+	// 0 is EDistane::MeleeRange, 1 is EDistane::PreferredDistance, 2 is EDistance::BadRange
+	FORCEINLINE uint8 GetDistanceBand(float DistanceSquared) const
+	{
+		if (DistanceSquared <= MeleeRangeSquared)
+			return 0;
+		return (DistanceSquared >= PreferredMinSquared && DistanceSquared <= PreferredMaxSquared) ? 1 : 2;
+	}
+
+	// row name used for an enemy type in the enemy data table
+	static FName GetRowName(EEnemyType EnemyType);
+
+	// what enemies without a data table (or with a missing row) use
+	static const FEnemyData& GetDefaultRow();
+
+	static TSharedRef<FEnemyArchetype> Build(const UDataTable* DataTable, EEnemyType EnemyType);
+};
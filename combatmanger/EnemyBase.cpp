@@ -9,6 +9,7 @@
 #include "Kismet/GamePlayStatics.h"
 #include "Sound/SoundCue.h"
 #include "Components/CapsuleComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Kismet/KismetSystemLibrary.h"
 
@@ -29,6 +30,13 @@
 
 #include "CombatManager.h"
 #include "WaveManager.h"
+#include "CombatSubsystem.h"
+#include "EnemyProjectilePool.h"
+#include "EnemyPool.h"
+#include "CombatCorpseManager.h"
+#include "EnemyBulletManager.h"
+#include "CombatMath.h"
+#include "EnemyArchetype.h"
 
 #include "GameFramework/ProjectileMovementComponent.h"
 
@@ -43,16 +51,32 @@ StaggerState(0),
 LocIndex(-1),
 bStaggered(false),
 staggerTime(1.0f),
+DelayedShotsLeft(0),
+ActivatedWeakSpots(0),
 deathCleanUpTime(30.f),
+bUseSimulatedProjectiles(false),
+TripleShotPattern(EBulletPatternType::Spread, 3, 5.f),
+VolleyPattern(EBulletPatternType::Spread, 3, 5.f),
+PatternPhase(0.f),
 spawnTime(2.5f),
 dissolveTime(2.5f),
 bAlive(true),
 CombatManager(NULL),
 bToken(false),
+LOSTraceRadius(25.f),
+bCachedLOS(false),
+LOSTimeStamp(-BIG_NUMBER),
+bLOSTracePending(false),
+UpdateTier(EEnemyUpdateTier::High),
+DistanceBand(MAX_uint8),
+LastEnemyInfoTime(-BIG_NUMBER),
+LastLOSUpdateTime(-BIG_NUMBER),
+LastPositionUpdateTime(-BIG_NUMBER),
 bInAttackRange(false),
+bPrewarmedForPool(false),
 AttackR(TEXT("MeleeAttack"))
 {
- 	// Set this character to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+ 	// Only Blueprint ticks on the enemy, how often is up to the update tier the combat manager gives it (Dormant doesn't tick)
 	PrimaryActorTick.bCanEverTick = true;
 
 	GetMesh()->SetCollisionProfileName(FName("Enemy"));
@@ -62,6 +86,11 @@ AttackR(TEXT("MeleeAttack"))
 	MeleeAttackCollision->SetupAttachment(GetMesh(), FName("MeleeSocket"));
 
 	AutoPossessAI = EAutoPossessAI::PlacedInWorldOrSpawned;
+
+	// 1: left arm, 2: right arm, 3: left leg. Lower arm, hand, calf and foot are covered by their parents
+	StaggerRegionRoots.Add(FName("upperarm_l"), 1);
+	StaggerRegionRoots.Add(FName("upperarm_r"), 2);
+	StaggerRegionRoots.Add(FName("thigh_l"), 3);
 	
 }
 
@@ -71,9 +100,14 @@ void AEnemyBase::BeginPlay()
 	Super::BeginPlay();
 
 	SetEnemyData();
+
+	MeshRelativeTransform = GetMesh()->GetRelativeTransform();
 	
 	PlayerRef = GetPlayer();
-	ActivateController();
+
+	// a prewarmed enemy gets parked at the origin right away, its behavior tree starts once a spawner takes it out of the pool
+	if (!bPrewarmedForPool)
+		ActivateController();
 
 	// Bind the overlap for weaponCollisionBox
 	MeleeAttackCollision->OnComponentBeginOverlap.AddDynamic(this, &AEnemyBase::OnMeleeAttackOverlap);
@@ -138,21 +172,81 @@ void AEnemyBase::PlaySpawningFX()
 {
 	UNiagaraComponent* NC_Appear = nullptr;
 	
-	if(EnemyRow.NS_Spawning)
+	if(GetEnemyRow().NS_Spawning)
 	{
 		GetMesh()->bComponentUseFixedSkelBounds=true;
-		NC_Appear = UNiagaraFunctionLibrary::SpawnSystemAtLocation(GetWorld(),EnemyRow.NS_Spawning,GetActorLocation());
-		UNiagaraFunctionLibrary::OverrideSystemUserVariableSkeletalMeshComponent(NC_Appear,FString("SkeletalMesh"),GetMesh());
-		NC_Appear->SetNiagaraVariableLinearColor("Color", P_Color * 10.f);
+		// not from the FX pool, AppearFX hands the component to Blueprint and it may keep it around
+		NC_Appear = UNiagaraFunctionLibrary::SpawnSystemAtLocation(GetWorld(), GetEnemyRow().NS_Spawning, GetActorLocation());
+		if (NC_Appear)
+		{
+			UNiagaraFunctionLibrary::OverrideSystemUserVariableSkeletalMeshComponent(NC_Appear,FString("SkeletalMesh"),GetMesh());
+			NC_Appear->SetNiagaraVariableLinearColor("Color", P_Color * 10.f);
+		}
 	}
 	
-	if(EnemyRow.SFX_Spawning)
-		UGameplayStatics::PlaySoundAtLocation(GetWorld(),EnemyRow.SFX_Spawning,GetActorLocation());
+	if(GetEnemyRow().SFX_Spawning)
+		PlayCombatSound(GetEnemyRow().SFX_Spawning, ECombatAudioCategory::Spawn);
 
 	// this calls a Blueprint function. Implement it per enemy type
 	AppearFX(NC_Appear);
 }
 
+void AEnemyBase::PlayCombatSound(USoundBase* Sound, ECombatAudioCategory Category, USceneComponent* AttachTo, FName SocketName)
+{
+	if (!Sound)
+		return;
+
+	const FVector Location = AttachTo ? AttachTo->GetSocketLocation(SocketName) : GetActorLocation();
+
+	// the aggregator merges the same cue from enemies dying / getting hit together and keeps the voice count in budget
+	if (UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>())
+		CombatSubsystem->PlayCombatSound(Sound, Location, Category, AttachTo, SocketName);
+	else if (AttachTo)
+		UGameplayStatics::SpawnSoundAttached(Sound, AttachTo, SocketName);
+	else
+		UGameplayStatics::PlaySoundAtLocation(this, Sound, Location);
+}
+
+UNiagaraComponent* AEnemyBase::SpawnCombatFX(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation, USceneComponent* AttachTo, FName SocketName)
+{
+	if (!System)
+		return nullptr;
+
+	// the pool recycles the components and culls effects too far from the player or over the per system cap
+	if (UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>())
+	{
+		return AttachTo ? CombatSubsystem->SpawnCombatFXAttached(System, AttachTo, SocketName)
+			: CombatSubsystem->SpawnCombatFX(System, Location, Rotation);
+	}
+
+	if (AttachTo)
+		return UNiagaraFunctionLibrary::SpawnSystemAttached(System, AttachTo, SocketName, FVector::ZeroVector, FRotator::ZeroRotator, EAttachLocation::SnapToTarget, true);
+
+	return UNiagaraFunctionLibrary::SpawnSystemAtLocation(this, System, Location, Rotation);
+}
+
+void AEnemyBase::GatherFXSystems(UCombatSubsystem* CombatSubsystem, TArray<UNiagaraSystem*>& OutSystems) const
+{
+	if (NSBlood)
+		OutSystems.AddUnique(NSBlood);
+	if (NS_FireParticle)
+		OutSystems.AddUnique(NS_FireParticle);
+
+	// the data table row isn't set on the class default object, go through the shared archetype
+	if (!CombatSubsystem)
+		return;
+
+	TSharedPtr<const FEnemyArchetype> ClassArchetype = CombatSubsystem->GetArchetype(EnemyDataTableObject, EnemyType);
+	if (!ClassArchetype.IsValid())
+		return;
+
+	for (const FWeakSpot& WeakSpot : ClassArchetype->Row->WeakSpots)
+	{
+		if (WeakSpot.NS_WeakSpotParticle)
+			OutSystems.AddUnique(WeakSpot.NS_WeakSpotParticle);
+	}
+}
+
 void AEnemyBase::ActivateController()
 {
 	
@@ -160,24 +254,63 @@ void AEnemyBase::ActivateController()
 	if (EnemyController && bAlive)
 	{
 		EnemyController->RunBehaviorTree(BehaviorTree);
+		ResetBlackboardProxy();
 
 		// Set the FireRate var in BlackBoard
-		EnemyController->GetBlackboardComponent()->SetValueAsFloat(FName("FireRate"), EnemyRow.FiraRate);
+		BlackboardProxy.SetFireRate(GetEnemyRow().FiraRate);
 
 
 		if (PlayerRef)
 		{
 			EnemyController->SetFocus(PlayerRef);
-			EnemyController->GetBlackboardComponent()->SetValueAsObject(FName("Target"), PlayerRef);
+			BlackboardProxy.SetTarget(PlayerRef);
 		}
 	}
 }
 
-// Called every frame
-void AEnemyBase::Tick(float DeltaTime)
+void AEnemyBase::ResetBlackboardProxy()
 {
-	Super::Tick(DeltaTime);
+	UBlackboardComponent* Blackboard = EnemyController ? EnemyController->GetBlackboardComponent() : nullptr;
+	const UBlackboardData* BlackboardAsset = Blackboard ? Blackboard->GetBlackboardAsset() : nullptr;
+
+	// key IDs are resolved once per blackboard asset and shared between the enemies
+	TSharedPtr<const FEnemyBlackboardKeys> Keys;
+	if (UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>())
+		Keys = CombatSubsystem->GetBlackboardKeys(BlackboardAsset);
+	else
+		Keys = FEnemyBlackboardKeys::Build(BlackboardAsset);
 
+	BlackboardProxy.Reset(Blackboard, Keys);
+
+	// a new blackboard doesn't have the band yet
+	DistanceBand = MAX_uint8;
+}
+
+void AEnemyBase::SetUpdateTier(EEnemyUpdateTier Tier, const FEnemyUpdateTierSettings& Settings)
+{
+	UpdateSettings = Settings;
+
+	if (Tier == UpdateTier)
+		return;
+
+	UpdateTier = Tier;
+
+	SetActorTickEnabled(Tier != EEnemyUpdateTier::Dormant);
+	SetActorTickInterval(Settings.TickInterval);
+
+	GetMesh()->SetComponentTickInterval(Settings.MeshTickInterval);
+	GetMesh()->VisibilityBasedAnimTickOption = Settings.bOnlyAnimateWhenRendered ? EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered
+		: EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones;
+}
+
+bool AEnemyBase::ShouldRunAIUpdate(float& LastUpdateTime) const
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+	if (Now - LastUpdateTime < UpdateSettings.AIUpdateInterval)
+		return false;
+
+	LastUpdateTime = Now;
+	return true;
 }
 
 // Called to bind functionality to input
@@ -217,56 +350,133 @@ void AEnemyBase::Wake()
 
 void AEnemyBase::SetEnemyData()
 {
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+
+	// the stagger regions only depend on the class and the mesh, resolve them once for all enemies sharing both
+	if (CombatSubsystem)
+		StaggerTable = CombatSubsystem->GetStaggerTable(GetClass(), GetMesh()->SkeletalMesh, StaggerRegionRoots);
+	else
+		StaggerTable = FEnemyStaggerTable::Build(GetMesh()->SkeletalMesh, StaggerRegionRoots);
+
+	// Every enemy of the same data table + type shares one archetype, only the weak spot activation is per instance
+	if (CombatSubsystem)
+		Archetype = CombatSubsystem->GetArchetype(EnemyDataTableObject, EnemyType);
+	else
+		Archetype = FEnemyArchetype::Build(EnemyDataTableObject, EnemyType);
+
+	ActivatedWeakSpots = 0;
+
 	if (EnemyDataTableObject) // Check if we have a datatable assigned to this entity in the editor.
 	{
-		switch (EnemyType)
-		{
-		case EEnemyType::small:
-			EnemyRow = *EnemyDataTableObject->FindRow<FEnemyData>(FName("small"), TEXT(""));
-			break;
+		Health = static_cast<float>(GetEnemyRow().EnemyHealth);
+		maxHealth = static_cast<float>(GetEnemyRow().EnemyHealth);
 
-		case EEnemyType::medium:
-			EnemyRow = *EnemyDataTableObject->FindRow<FEnemyData>(FName("medium"), TEXT(""));
-			break;
+		// Compile the bone -> weak spot lookup once per archetype, every enemy of the same type and mesh shares it
+		if (CombatSubsystem)
+			WeakSpotTable = CombatSubsystem->GetWeakSpotTable(EnemyDataTableObject, EnemyType, GetMesh()->SkeletalMesh, GetEnemyRow().WeakSpots);
+		else
+			WeakSpotTable = FEnemyWeakSpotTable::Build(GetMesh()->SkeletalMesh, GetEnemyRow().WeakSpots);
+	}
+}
 
-		case EEnemyType::large:
-			EnemyRow = *EnemyDataTableObject->FindRow<FEnemyData>(FName("large"), TEXT(""));
-			break;
+const FEnemyData& AEnemyBase::GetEnemyRow() const
+{
+	return Archetype.IsValid() ? *Archetype->Row : FEnemyArchetype::GetDefaultRow();
+}
+
+void AEnemyBase::BulletHit_Implementation(FHitResult HitResult, FWeaponHitData WeaponHitData)
+{
+	ApplyBulletHits(MakeArrayView(&HitResult, 1), WeaponHitData);
+}
+
+void AEnemyBase::BulletHitBatch(const TArray<FHitResult>& HitResults, const FWeaponHitData& WeaponHitData)
+{
+	ApplyBulletHits(HitResults, WeaponHitData);
+}
+
+void AEnemyBase::DispatchBatchedHits(const TArray<FHitResult>& HitResults, const FWeaponHitData& WeaponHitData)
+{
+	// group the hits per enemy, every enemy then takes all of its pellets in one call
+	TMap<AEnemyBase*, TArray<FHitResult>> HitsPerEnemy;
+
+	for (const FHitResult& currentHit : HitResults)
+	{
+		AActor* HitActor = currentHit.GetActor();
+		if (!HitActor)
+			continue;
+
+		if (AEnemyBase* Enemy = Cast<AEnemyBase>(HitActor))
+		{
+			HitsPerEnemy.FindOrAdd(Enemy).Add(currentHit);
 		}
-		Health = static_cast<float>(EnemyRow.EnemyHealth);
-		maxHealth = static_cast<float>(EnemyRow.EnemyHealth);
+		else if (HitActor->GetClass()->ImplementsInterface(UBulletHitInteface::StaticClass()))
+		{
+			// anything else that can be shot still gets its hits one by one
+			IBulletHitInteface::Execute_BulletHit(HitActor, currentHit, WeaponHitData);
+		}
+	}
+
+	// go through the overridable entry points so subclasses that customise their hit handling still see every hit
+	for (TPair<AEnemyBase*, TArray<FHitResult>>& current : HitsPerEnemy)
+	{
+		if (current.Value.Num() == 1)
+			IBulletHitInteface::Execute_BulletHit(current.Key, current.Value[0], WeaponHitData);
+		else
+			current.Key->BulletHitBatch(current.Value, WeaponHitData);
 	}
 }
 
-void AEnemyBase::BulletHit_Implementation(FHitResult HitResult, FWeaponHitData WeaponHitData)
+void AEnemyBase::ApplyBulletHits(TArrayView<const FHitResult> HitResults, const FWeaponHitData& WeaponHitData)
 {
-	// If there is a sound effect available , play it.
+	if (!HitResults.Num())
+		return;
+
+	// One impact sound for the whole shot
 	if (ImpactSound)
 	{
-		UGameplayStatics::PlaySoundAtLocation(this, ImpactSound, GetActorLocation());
+		PlayCombatSound(ImpactSound, ECombatAudioCategory::Impact);
 	}
-	float Damage = static_cast<float>(WeaponHitData.hitDamage);
-	
-	// Apply the weapon multiplier to the damage based on the type of ammo the damage was instigated by.
-	ApplyAmmoTypeMultiplier(Damage, WeaponHitData.hitAmmoType);
-	// apply WeakSpotMultiplier after ammo type multiplier
-	// ammo type multiplier is multiplicative while weakspot multiplier is additive
-	CheckWeakSpotHit(Damage, HitResult, WeaponHitData);
-	
-	// Log the damage into the console.
 
-	// Apply Damage.
-	Health -= Damage;
-	if (EnemyRow.EnemyFaction == EEnemyFaction::Infested)
+	float TotalDamage = 0.f;
+	int32 StrongestHit = 0;
+	float StrongestDamage = -1.f;
+
+	// Damage and weak spots are still resolved per pellet
+	for (int32 i = 0; i != HitResults.Num(); ++i)
+	{
+		float Damage = static_cast<float>(WeaponHitData.hitDamage);
+
+		// Apply the weapon multiplier to the damage based on the type of ammo the damage was instigated by.
+		ApplyAmmoTypeMultiplier(Damage, WeaponHitData.hitAmmoType);
+		// apply WeakSpotMultiplier after ammo type multiplier
+		// ammo type multiplier is multiplicative while weakspot multiplier is additive
+		CheckWeakSpotHit(Damage, HitResults[i], WeaponHitData);
+
+		// Apply Damage. (per pellet, so the weak spot of the next pellet sees the health left after this one)
+		Health -= Damage;
+		TotalDamage += Damage;
+
+		if (Damage > StrongestDamage)
+		{
+			StrongestDamage = Damage;
+			StrongestHit = i;
+		}
+	}
+
+	// the strongest pellet decides where the blood comes from and which bone staggers
+	const FHitResult& MainHit = HitResults[StrongestHit];
+
+	if (GetEnemyRow().EnemyFaction == EEnemyFaction::Infested)
 	{
 		if (WeaponHitData.hitWeaponType == EWeaponType::Shotgun)
 		{
-				PlayerRef->IncreaseInfestedCharge(Damage * 0.2f);
+				PlayerRef->IncreaseInfestedCharge(TotalDamage * 0.2f);
 		}
 		else
-			PlayerRef->IncreaseInfestedCharge(Damage * 0.1f);
+			PlayerRef->IncreaseInfestedCharge(TotalDamage * 0.1f);
 		
-		SpawnBloodParticles(HitResult, Damage);
+		// one blood system, the particle count comes from the damage of all pellets
+		SpawnBloodParticles(MainHit, TotalDamage);
 	}
 
 	// If the damage applied takes the enemies health below 1 we kill the enemy.
@@ -275,10 +485,10 @@ void AEnemyBase::BulletHit_Implementation(FHitResult HitResult, FWeaponHitData W
 		Die();
 	}
 	
-	if(WeaponHitData.hitStagger >= EnemyRow.StaggerValue)
-	PlayStaggerAnimation(HitResult.BoneName);
+	if(WeaponHitData.hitStagger >= GetEnemyRow().StaggerValue)
+	PlayStaggerAnimation(MainHit.BoneName);
 
-	if(EnemyRow.EnemyFaction != EEnemyFaction::Robot && !PlayerRef->CurrentWeapon->GetIsBloody())
+	if(GetEnemyRow().EnemyFaction != EEnemyFaction::Robot && !PlayerRef->CurrentWeapon->GetIsBloody())
 	RangeTestForBlood(GetActorLocation(), 500.0f);
 }
 
@@ -287,17 +497,17 @@ void AEnemyBase::ApplyAmmoTypeMultiplier(float& Damage, const EAmmoType& AmmoTyp
 	// Apply the weapon multiplier to the damage based on the type of ammo the damage was instigated by.
 	switch (AmmoType)
 	{
-	case EAmmoType::Bullet: Damage *= EnemyRow.BulletMultiplier;
+	case EAmmoType::Bullet: Damage *= GetEnemyRow().BulletMultiplier;
 		break;
-	case EAmmoType::Shell: Damage *= EnemyRow.ShellMultiplier;
+	case EAmmoType::Shell: Damage *= GetEnemyRow().ShellMultiplier;
 		break;
-	case EAmmoType::Cell: Damage *= EnemyRow.CellMultiplier;
+	case EAmmoType::Cell: Damage *= GetEnemyRow().CellMultiplier;
 		break;
-	case EAmmoType::Rocket: Damage *= EnemyRow.RocketMultiplier;
+	case EAmmoType::Rocket: Damage *= GetEnemyRow().RocketMultiplier;
 		break;
-	case EAmmoType::None: Damage *= EnemyRow.PistolMultiplier;
+	case EAmmoType::None: Damage *= GetEnemyRow().PistolMultiplier;
 		break;
-	case EAmmoType::Melee: Damage *= EnemyRow.MeleeMultiplier;
+	case EAmmoType::Melee: Damage *= GetEnemyRow().MeleeMultiplier;
 		break;
 	default:
 		break;
@@ -311,24 +521,22 @@ void AEnemyBase::CheckWeakSpotHit(float& Damage, const FHitResult& HitResult, co
 	// When working with weakspots we should place the bone we want to hide as the first bone in the array and use that to hide parts of the body.
 	// We probably want to create sockets to spawn gibs (name the sockets as the weakspot they are referring to)
 	
-	// We check every weakspot the enemy has
-	for(FWeakSpot& currentWeakSpot : EnemyRow.WeakSpots)
+	if (!WeakSpotTable.IsValid())
+		return;
+
+	// one lookup on the hit bone in the precompiled table. No loops and no string work
+	const int32 WeakSpotIndex = WeakSpotTable->FindWeakSpot(HitResult.BoneName);
+	if (WeakSpotIndex == INDEX_NONE || !GetEnemyRow().WeakSpots.IsValidIndex(WeakSpotIndex) || WeakSpotIndex >= 32)
+		return;
+
+	// the row is shared, whether this enemy already had the weak spot activated lives in our own bitmask
+	const FWeakSpot& currentWeakSpot = GetEnemyRow().WeakSpots[WeakSpotIndex];
+	const uint32 WeakSpotBit = 1u << WeakSpotIndex;
+	if(WeaponHitData.hitWeakSpotStrenght >= currentWeakSpot.weakSpotReq && (!(ActivatedWeakSpots & WeakSpotBit) || currentWeakSpot.bCanBeRepeated))
 	{
-		// check every bone corresponding to the current weakspot
-		for(const FName& BoneName : currentWeakSpot.weakSpotBoneNames)
-		{
-			if(HitResult.BoneName == BoneName)
-			{
-				if(WeaponHitData.hitWeakSpotStrenght >= currentWeakSpot.weakSpotReq && (!currentWeakSpot.bHasBeenActivated || currentWeakSpot.bCanBeRepeated))
-				{
-					Damage += currentWeakSpot.weakSpotDamage;
-					HandleWeakSpotHit(HitResult, currentWeakSpot, Damage);
-					currentWeakSpot.bHasBeenActivated = true;
-				}
-				return;
-			}
-		}
-		
+		Damage += currentWeakSpot.weakSpotDamage;
+		HandleWeakSpotHit(HitResult, currentWeakSpot, Damage);
+		ActivatedWeakSpots |= WeakSpotBit;
 	}
 }
 
@@ -341,10 +549,8 @@ void AEnemyBase::HandleWeakSpotHit(const FHitResult& HitResult, const FWeakSpot&
 	// Keep the naming convention consistent...
 	// The socket name should be the first boneName in the NameArray + Socket
 	// i.e if the weakspotBoneNames[0] = head , the socket name should be headSocket
-	FString weakSpotString;
-	WeakSpot.weakSpotBoneNames[0].ToString(weakSpotString);
-	weakSpotString.Append("Socket");
-	FName socketName = FName(*weakSpotString);
+	// the socket names are resolved once when the weak spot table is built
+	const FName socketName = GetWeakSpotSocketName(HitResult.BoneName);
 	
 	//float healthValue = std::max(Health - Damage, 0.0f);
 	//UE_LOG(LogTemp,Warning,TEXT("EnemyHealthValue: %f"),healthValue);
@@ -359,15 +565,13 @@ void AEnemyBase::HandleWeakSpotHit(const FHitResult& HitResult, const FWeakSpot&
 			if(WeakSpot.NS_WeakSpotParticle)
 			{
 				
-				UNiagaraFunctionLibrary::SpawnSystemAttached(WeakSpot.NS_WeakSpotParticle,GetMesh(),
-					socketName,
-					GetMesh()->GetSocketLocation(socketName),GetMesh()->GetSocketRotation(socketName),EAttachLocation::KeepRelativeOffset,false);
+				SpawnCombatFX(WeakSpot.NS_WeakSpotParticle, FVector::ZeroVector, FRotator::ZeroRotator, GetMesh(), socketName);
 			}
 
 			// Spawn weakpoint hit sound
 			if(WeakSpot.SFX_WeakSpotSound)
 			{
-				UGameplayStatics::SpawnSoundAttached(WeakSpot.SFX_WeakSpotSound,GetMesh(),socketName);
+				PlayCombatSound(WeakSpot.SFX_WeakSpotSound, ECombatAudioCategory::WeakSpot, GetMesh(), socketName);
 			}
 			
 			// Hide corresponding body parts
@@ -379,15 +583,13 @@ void AEnemyBase::HandleWeakSpotHit(const FHitResult& HitResult, const FWeakSpot&
 		// Spawn Particles
 		if(WeakSpot.NS_WeakSpotParticle)
 		{
-			UNiagaraFunctionLibrary::SpawnSystemAttached(WeakSpot.NS_WeakSpotParticle,GetMesh(),
-					socketName,
-					GetMesh()->GetSocketLocation(socketName),GetMesh()->GetSocketRotation(socketName),EAttachLocation::KeepRelativeOffset,false);
+			SpawnCombatFX(WeakSpot.NS_WeakSpotParticle, FVector::ZeroVector, FRotator::ZeroRotator, GetMesh(), socketName);
 		}
 
 		// Spawn weakpoint hit sound
 		if(WeakSpot.SFX_WeakSpotSound)
 		{
-			UGameplayStatics::SpawnSoundAttached(WeakSpot.SFX_WeakSpotSound,GetMesh(),socketName);
+			PlayCombatSound(WeakSpot.SFX_WeakSpotSound, ECombatAudioCategory::WeakSpot, GetMesh(), socketName);
 		}
 			
 		// Hide corresponding body parts
@@ -395,14 +597,24 @@ void AEnemyBase::HandleWeakSpotHit(const FHitResult& HitResult, const FWeakSpot&
 	}
 }
 
+FName AEnemyBase::GetWeakSpotSocketName(FName BoneName) const
+{
+	if (!WeakSpotTable.IsValid())
+		return NAME_None;
+
+	const int32 WeakSpotIndex = WeakSpotTable->FindWeakSpot(BoneName);
+	return WeakSpotTable->SocketNames.IsValidIndex(WeakSpotIndex) ? WeakSpotTable->SocketNames[WeakSpotIndex] : NAME_None;
+}
+
 void AEnemyBase::ReceiveParticleData_Implementation(const TArray<FBasicParticleData>& Data, UNiagaraSystem* NiagaraSystem)
 {
-	if (BloodDecal)
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (BloodDecal && CombatSubsystem)
 	{
 		for (const FBasicParticleData& current : Data)
 		{
 			//UE_LOG(LogTemp, Warning, TEXT("%s"), *current.Position.ToString());
-			UGameplayStatics::SpawnDecalAtLocation(GetWorld(), BloodDecal, FVector(20.f, 202.f, 202.f), current.Position, -1 * current.Velocity.Rotation(),10.f);
+			CombatSubsystem->SpawnDecal(BloodDecal, FVector(20.f, 202.f, 202.f), current.Position, -1 * current.Velocity.Rotation(),10.f);
 		}
 	}
 }
@@ -414,7 +626,10 @@ UNiagaraComponent* AEnemyBase::SpawnBloodParticles(const FHitResult& HitResult,
 		int32 particlesNum = static_cast<int32>(Damage);
 		particlesNum *= 0.2f;
 		//UE_LOG(LogTemp, Warning, TEXT("BloodParticles Triggered"));
-		UNiagaraComponent* Blood = UNiagaraFunctionLibrary::SpawnSystemAtLocation(this, NSBlood, HitResult.ImpactPoint, HitResult.ImpactNormal.Rotation());
+		UNiagaraComponent* Blood = SpawnCombatFX(NSBlood, HitResult.ImpactPoint, HitResult.ImpactNormal.Rotation());
+		if (!Blood)
+			return nullptr;
+
 		Blood->SetColorParameter(FName("Color"), FLinearColor::Red);
 		Blood->SetIntParameter(FName("HitDamage"), particlesNum);
 		if (CombatManager)
@@ -430,13 +645,13 @@ UNiagaraComponent* AEnemyBase::SpawnBloodParticles(const FHitResult& HitResult,
 
 void AEnemyBase::PlayStaggerAnimation(const FName& HitBone)
 {
-	UE_LOG(LogTemp, Warning, TEXT("%s"), *HitBone.ToString());
-	if (HitBone == "upperarm_l" || HitBone == "lowerarm_l" || HitBone == "hand_l")
-		StaggerState = 1;
-	else if (HitBone == "upperarm_r" || HitBone == "lowerarm_r" || HitBone == "hand_r")
-		StaggerState = 2;
-	else if (HitBone == "thigh_l" || HitBone == "calf_l" || HitBone == "foot_l")
-		StaggerState = 3;
+	if (!StaggerTable.IsValid())
+		return;
+
+	// 0 means the bone isn't part of a stagger region, keep the current state then
+	const int32 Region = StaggerTable->FindRegion(GetMesh()->GetBoneIndex(HitBone));
+	if (Region != 0)
+		StaggerState = Region;
 
 }
 
@@ -453,9 +668,10 @@ void AEnemyBase::DieFromSpawn()
 		GetCapsuleComponent()->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 		GetMesh()->SetCollisionProfileName(FName("Ragdoll"));
 		GetMesh()->SetSimulatePhysics(true);
+		RegisterCorpse();
 
-		if(EnemyRow.SFX_Death)
-			UGameplayStatics::PlaySoundAtLocation(GetWorld(),EnemyRow.SFX_Death,GetActorLocation());
+		if(GetEnemyRow().SFX_Death)
+			PlayCombatSound(GetEnemyRow().SFX_Death, ECombatAudioCategory::Death);
 
 		OnDestroyed.Broadcast(this);	// this initiates the exploding component if the enemy has it
 
@@ -477,9 +693,10 @@ void AEnemyBase::Die()
 		GetCapsuleComponent()->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 		GetMesh()->SetCollisionProfileName(FName("Ragdoll"));
 		GetMesh()->SetSimulatePhysics(true);
+		RegisterCorpse();
 		
-		if(EnemyRow.SFX_Death)
-		UGameplayStatics::PlaySoundAtLocation(GetWorld(),EnemyRow.SFX_Death,GetActorLocation());
+		if(GetEnemyRow().SFX_Death)
+		PlayCombatSound(GetEnemyRow().SFX_Death, ECombatAudioCategory::Death);
 
 		OnDestroyed.Broadcast(this);	// this initiates the exploding component if the enemy has it
 
@@ -512,12 +729,152 @@ void AEnemyBase::SignalDeath()
 	UE_LOG(LogTemp, Warning, TEXT("SIGNAL DEATH"));
 	GetWorld()->GetTimerManager().ClearTimer(DeathTimer);
 
+	// the next spawn of this class reuses us, the controller stays with the enemy
+	if (UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>())
+	{
+		if (CombatSubsystem->GetCorpseManager())
+			CombatSubsystem->GetCorpseManager()->UnregisterCorpse(this);
+
+		if (CombatSubsystem->GetEnemyPool())
+		{
+			CombatSubsystem->GetEnemyPool()->Release(this);
+			return;
+		}
+	}
+
 	// TODO Destroy the controller aswell
 	
 	MarkPendingKill();
 	Destroy();
 }
 
+void AEnemyBase::RegisterCorpse()
+{
+	if (UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>())
+	{
+		if (CombatSubsystem->GetCorpseManager())
+			CombatSubsystem->GetCorpseManager()->RegisterCorpse(this);
+	}
+}
+
+void AEnemyBase::FreezeRagdoll()
+{
+	// stop the skeleton first, otherwise turning physics off blends the mesh back to the animated pose
+	GetMesh()->bNoSkeletonUpdate = true;
+	GetMesh()->SetComponentTickEnabled(false);
+	GetMesh()->SetSimulatePhysics(false);
+	GetMesh()->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+void AEnemyBase::DeactivateForPool()
+{
+	GetWorldTimerManager().ClearAllTimersForObject(this);
+
+	ReleaseToken();
+
+	if (!EnemyController)
+		EnemyController = Cast<AEnemyController>(GetController());
+	if (EnemyController && EnemyController->GetPawn() == this)
+		EnemyController->UnPossess();
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+
+	// a corpse still simulating would keep the physics scene busy while it waits in the pool
+	GetMesh()->SetSimulatePhysics(false);
+	GetMesh()->SetComponentTickEnabled(false);
+
+	GetCharacterMovement()->StopMovementImmediately();
+	GetCharacterMovement()->DisableMovement();
+	GetCharacterMovement()->SetComponentTickEnabled(false);
+
+	CombatManager = nullptr;
+	SpawnerManager = nullptr;
+	waveManagerRef = nullptr;
+}
+
+void AEnemyBase::ResetFromPool()
+{
+	GetWorldTimerManager().ClearAllTimersForObject(this);
+
+	// Health and combat state
+	bAlive = true;
+	Health = maxHealth;
+	bToken = false;
+	LocIndex = -1;
+	StaggerState = 0;
+	bStaggered = false;
+	bInAttackRange = false;
+	bPrewarmedForPool = false;
+	DelayedShotsLeft = 0;
+	PatternPhase = 0.f;
+	DoOnce.Reset();
+
+	// Weak spots, show the body parts the last life shot off again
+	const bool bHadHiddenBones = ActivatedWeakSpots != 0;
+	for (int32 i = 0; i != GetEnemyRow().WeakSpots.Num(); ++i)
+	{
+		const FWeakSpot& WeakSpot = GetEnemyRow().WeakSpots[i];
+		if ((ActivatedWeakSpots & (1u << i)) && WeakSpot.weakSpotBoneNames.Num())
+			GetMesh()->UnHideBoneByName(WeakSpot.weakSpotBoneNames[0]);
+	}
+	ActivatedWeakSpots = 0;
+
+	// Ragdoll off, mesh back in the capsule with the profiles it spawned with
+	GetMesh()->SetSimulatePhysics(false);
+	GetMesh()->AttachToComponent(GetCapsuleComponent(), FAttachmentTransformRules::SnapToTargetNotIncludingScale);
+	GetMesh()->SetRelativeTransform(MeshRelativeTransform);
+	GetMesh()->SetCollisionProfileName(FName("Enemy"));
+	GetMesh()->bComponentUseFixedSkelBounds = false;
+	GetMesh()->bNoSkeletonUpdate = false;		// frozen by the corpse manager
+	GetMesh()->SetComponentTickEnabled(true);
+
+	// hiding the weak spot bones terminated their physics bodies (PBO_Term) and unhiding doesn't bring them back,
+	// without them the limb can't be hit and is missing from the ragdoll
+	if (bHadHiddenBones)
+		GetMesh()->RecreatePhysicsState();
+
+	GetCapsuleComponent()->SetCollisionProfileName(FName("Enemy"));
+	GetCapsuleComponent()->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+
+	MeleeAttackCollision->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	GetCharacterMovement()->SetComponentTickEnabled(true);
+	GetCharacterMovement()->SetDefaultMovementMode();
+
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	// Cached AI state
+	bCachedLOS = false;
+	LOSTimeStamp = -BIG_NUMBER;
+	bLOSTracePending = false;
+	DistanceBand = MAX_uint8;
+	LastEnemyInfoTime = -BIG_NUMBER;
+	LastLOSUpdateTime = -BIG_NUMBER;
+	LastPositionUpdateTime = -BIG_NUMBER;
+
+	UpdateTier = EEnemyUpdateTier::High;
+	UpdateSettings = FEnemyUpdateTierSettings();
+	SetActorTickEnabled(true);
+	SetActorTickInterval(0.f);
+	GetMesh()->SetComponentTickInterval(0.f);
+	GetMesh()->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones;
+
+	// the controller stayed with us, InitiateSpawn / Spawn possess it again. Only replace it if it got destroyed
+	if (!IsValid(EnemyController))
+	{
+		EnemyController = nullptr;
+		SpawnDefaultController();
+		EnemyController = Cast<AEnemyController>(GetController());
+	}
+
+	PlayerRef = GetPlayer();
+
+	OnResetFromPool();
+}
+
 
 void AEnemyBase::SetCombatManager(ACombatManager* OwningManager)
 {
@@ -541,29 +898,11 @@ void AEnemyBase::RangeTestForBlood(FVector Location, float Radius, float DebugDu
 		DrawDebugSphere(GetWorld(), Location, Radius, 16, DebugColor, false, DebugDuration);
 	}
 
-	//Create an ObjectType Array and fill it
-	TArray<TEnumAsByte<EObjectTypeQuery> > TraceObjectTypes;
-	TraceObjectTypes.Add(UEngineTypes::ConvertToObjectType(ECC_Player));
-
-	//Create an array of actors to ignore and fill it
-	TArray<AActor*> ObjectsToIgnore;
-	ObjectsToIgnore.Add(this);
-
-	// Create an Array of actors that will be filled by the function SphereOverlapActors
-	TArray<AActor*> OutActors;
-
-	//Creates an invisible sphere and fills up the OutActors array with the results that match the given conditions 
-	//It returns a bool that we can check if any of the overlapped actors even matched our criteria
-	if (UKismetSystemLibrary::SphereOverlapActors(this, Location, Radius, TraceObjectTypes, NULL, ObjectsToIgnore, OutActors))
+	// The only actor we care about is the player, so instead of a sphere overlap we check the distance to the cached player capsule
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (CombatSubsystem && PlayerRef && PlayerRef->CurrentWeapon && CombatSubsystem->IsPlayerWithin(Location, Radius))
 	{
-		for (AActor* HitActor : OutActors)
-		{
-			if (ACPP_CharacterBase* Player = Cast<ACPP_CharacterBase>(HitActor))
-			{
-					Player->CurrentWeapon->SetIsBloody(true);
-					break;
-			}
-		}
+		PlayerRef->CurrentWeapon->SetIsBloody(true);
 	}
 }
 
@@ -614,128 +953,217 @@ void AEnemyBase::DisableMeleeAttackCollision()
 
 FTransform AEnemyBase::CalculateInterception()
 {
-	FVector MuzzleLoc = GetMesh()->GetSocketLocation(FName("ProjectileSocket"));
-	FVector TargetLoc;
-	FVector TargetVelocity;
-	if(PlayerRef)
-	{
-	TargetLoc = PlayerRef->TargetHere->GetComponentLocation();
-	TargetVelocity = PlayerRef->GetVelocity();
-	}
-	else
-	{
-	TargetLoc = GetPlayer()->TargetHere->GetComponentLocation();
-	TargetVelocity = GetPlayer()->GetVelocity();
-	}
+	const FVector MuzzleLoc = GetMuzzleLocation();
 
-	FVector dX = UKismetMathLibrary::Subtract_VectorVector(TargetLoc, MuzzleLoc);
-	FVector dV = TargetVelocity - EnemyRow.ProjecileSpeed;
-	float time = UKismetMathLibrary::Divide_VectorVector(dX, dV).Size();
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (!CombatSubsystem)
+		return FTransform(GetActorRotation(), MuzzleLoc);
 
-	FVector Result = TargetLoc + TargetVelocity * time;
+	const FCombatPlayerSnapshot& Snapshot = CombatSubsystem->GetPlayerSnapshot();
+	if (!Snapshot.bValid)
+		return FTransform(GetActorRotation(), MuzzleLoc);
 
-	if (time > 0)
-	{
-		FRotator Rotator = UKismetMathLibrary::FindLookAtRotation(MuzzleLoc, Result);
-		FTransform SpawnTransform(Rotator, MuzzleLoc);
-		return SpawnTransform;
-	}
-	else
-	{
-		FRotator Rotator = UKismetMathLibrary::FindLookAtRotation(MuzzleLoc, TargetLoc);
-		FTransform SpawnTransform(Rotator, MuzzleLoc);
-		return SpawnTransform;
-	}
+	// solve for the time the projectile meets the player, if it can't we just aim at the player (done by the solver)
+	FVector AimPoint;
+	const float ProjectileSpeed = GetProjectileSpeed();
+	CombatMath::SolveInterceptAimPoints(MakeArrayView(&MuzzleLoc, 1), MakeArrayView(&ProjectileSpeed, 1), Snapshot.TargetLocation, Snapshot.Velocity, MakeArrayView(&AimPoint, 1));
 
+	return MakeMuzzleTransform(MuzzleLoc, AimPoint);
 }
 
-AEnemyProjectileBase* AEnemyBase::SpawnProjectile(FTransform& SpawnTransform)
+FTransform AEnemyBase::MakeMuzzleTransform(const FVector& MuzzleLoc, const FVector& AimPoint) const
+{
+	return FTransform(UKismetMathLibrary::FindLookAtRotation(MuzzleLoc, AimPoint), MuzzleLoc);
+}
+
+FVector AEnemyBase::GetMuzzleLocation() const
+{
+	return GetMesh()->GetSocketLocation(FName("ProjectileSocket"));
+}
+
+float AEnemyBase::GetProjectileSpeed() const
 {
-	if (ProjectileClass)
+	return GetEnemyRow().ProjecileSpeed;
+}
+
+void AEnemyBase::ApplyMovementInaccuracy(FTransform& SpawnTransform) const
+{
+	const FCombatPlayerSnapshot& Snapshot = GetPlayerSnapshot();
+	if (Snapshot.bValid && Snapshot.bIsMoving && !bToken)			// if the character is moving we add inaccuracy based on his movement rating
 	{
-		if (PlayerRef->GetIsCharacterMoving() && !bToken)			// if the character is moving we add inaccuracy based on his movement rating
+		float x = SpawnTransform.GetRotation().Rotator().Euler().X;
+		float y = SpawnTransform.GetRotation().Rotator().Euler().Y;		// leave this value alone
+		float z = SpawnTransform.GetRotation().Rotator().Euler().Z;
+
+		float MovementRatingMultiplier = Snapshot.MovementRating;		// Get the Rating and invert it for our use
+		if (MovementRatingMultiplier != 0)				//Check to see if it's zero, if so we want to inver it by setting it to one
 		{
-			float x = SpawnTransform.GetRotation().Rotator().Euler().X;
-			float y = SpawnTransform.GetRotation().Rotator().Euler().Y;		// leave this value alone
-			float z = SpawnTransform.GetRotation().Rotator().Euler().Z;
+			MovementRatingMultiplier -= 1;											// We invert it so the more similar the movement is the more accurate the AI will be
+			MovementRatingMultiplier *= -1;											// We invert it so the more similar the movement is the more accurate the AI will be
+		}																			
+		else
+			MovementRatingMultiplier = 1.f;
 
-			float MovementRatingMultiplier = PlayerRef->GetMovementRating();		// Get the Rating and invert it for our use
-			if (MovementRatingMultiplier != 0)				//Check to see if it's zero, if so we want to inver it by setting it to one
-			{
-				MovementRatingMultiplier -= 1;											// We invert it so the more similar the movement is the more accurate the AI will be
-				MovementRatingMultiplier *= -1;											// We invert it so the more similar the movement is the more accurate the AI will be
-			}																			
-			else
-				MovementRatingMultiplier = 1.f;
 
+		if (MovementRatingMultiplier <= 0.2f)				// We can also cap this so if the movement is up to a certain% similar the AI has perfect accuracy
+			MovementRatingMultiplier = 0.f;
 
-			if (MovementRatingMultiplier <= 0.2f)				// We can also cap this so if the movement is up to a certain% similar the AI has perfect accuracy
-				MovementRatingMultiplier = 0.f;
+		if (MovementRatingMultiplier != 0.f)
+		{
+			if (UKismetMathLibrary::RandomBool())
+				x += GetEnemyRow().AccuracyOffset * MovementRatingMultiplier;
+			else
+				x -= GetEnemyRow().AccuracyOffset * MovementRatingMultiplier;
 
-			if (MovementRatingMultiplier != 0.f)
-			{
-				if (UKismetMathLibrary::RandomBool())
-					x += EnemyRow.AccuracyOffset * MovementRatingMultiplier;
-				else
-					x -= EnemyRow.AccuracyOffset * MovementRatingMultiplier;
-
-				if (UKismetMathLibrary::RandomBool())
-					z += EnemyRow.AccuracyOffset * MovementRatingMultiplier;
-				else
-					z -= EnemyRow.AccuracyOffset * MovementRatingMultiplier;
-			}
-			
-			
-			//UE_LOG(LogTemp, Warning, TEXT("%f \t %f"), MovementRatingMultiplier, PlayerRef->GetMovementRating());
-			FRotator newRotator(y, z, x);
-			SpawnTransform.SetRotation(newRotator.Quaternion());
+			if (UKismetMathLibrary::RandomBool())
+				z += GetEnemyRow().AccuracyOffset * MovementRatingMultiplier;
+			else
+				z -= GetEnemyRow().AccuracyOffset * MovementRatingMultiplier;
 		}
 		
+		
+		//UE_LOG(LogTemp, Warning, TEXT("%f \t %f"), MovementRatingMultiplier, PlayerRef->GetMovementRating());
+		FRotator newRotator(y, z, x);
+		SpawnTransform.SetRotation(newRotator.Quaternion());
+	}
+}
+
+AEnemyProjectileBase* AEnemyBase::SpawnProjectile(FTransform& SpawnTransform)
+{
+	ApplyMovementInaccuracy(SpawnTransform);
+
+	SpawnProjectileBatch(MakeArrayView(&SpawnTransform, 1));
+	return Projectile;
+}
+
+void AEnemyBase::SpawnProjectileBatch(TArrayView<const FTransform> SpawnTransforms)
+{
+	Projectile = NULL;
+
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
 
-		Projectile = GetWorld()->SpawnActor<AEnemyProjectileBase>(ProjectileClass, SpawnTransform);
-		Projectile->SetProjectileData(FEnemyHitData(EnemyRow.PrimaryDamage,EnemyRow.EnemyFaction,EnemyRow.bSlowPlayer),EnemyRow.ProjecileSpeed);
-		return Projectile;
+	const FEnemyHitData HitData(GetEnemyRow().PrimaryDamage,GetEnemyRow().EnemyFaction,GetEnemyRow().bSlowPlayer);
+
+	// simulated bullets have no actor, the bullet manager owns them from here
+	if (bUseSimulatedProjectiles && CombatSubsystem && CombatSubsystem->GetBulletManager())
+	{
+		CombatSubsystem->GetBulletManager()->FireBullets(SpawnTransforms, GetEnemyRow().ProjecileSpeed, GetEnemyRow().PrimaryDamage, HitData, this);
+		return;
 	}
 
-	return NULL;
+	if (!ProjectileClass)
+		return;
+
+	// projectiles come from the pool, only fall back to spawning if there is no combat subsystem
+	UEnemyProjectilePool* ProjectilePool = CombatSubsystem ? CombatSubsystem->GetProjectilePool() : nullptr;
+
+	for (const FTransform& SpawnTransform : SpawnTransforms)
+	{
+		if (ProjectilePool)
+		{
+			Projectile = ProjectilePool->Acquire(ProjectileClass, SpawnTransform, HitData, GetEnemyRow().ProjecileSpeed);
+		}
+		else
+		{
+			Projectile = GetWorld()->SpawnActor<AEnemyProjectileBase>(ProjectileClass, SpawnTransform);
+			if (Projectile)
+				Projectile->SetProjectileData(HitData,GetEnemyRow().ProjecileSpeed);
+		}
+	}
 }
 
 void AEnemyBase::FireProjectile()
 {
+	FireProjectileFrom(CalculateInterception());
+}
 
+void AEnemyBase::FireProjectileFrom(FTransform SpawnTransform)
+{
 	RequestToken();
 
-	FTransform SpawnTransform = CalculateInterception();
 	SpawnProjectile(SpawnTransform);
 
 	ReleaseToken();
 }
 
 void AEnemyBase::FireTripleProjectile()
+{
+	FireTripleProjectileFrom(CalculateInterception());
+}
+
+void AEnemyBase::FireTripleProjectileFrom(FTransform SpawnTransform)
+{
+	FireVolleyFrom(SpawnTransform, TripleShotPattern);
+}
+
+void AEnemyBase::FireVolley()
+{
+	FireVolleyFrom(CalculateInterception(), VolleyPattern);
+}
+
+void AEnemyBase::FireVolleyFrom(FTransform AimTransform, const FEnemyBulletPattern& Pattern)
 {
 	RequestToken();
 
-	FTransform SpawnTransform = CalculateInterception();
-	SpawnProjectile(SpawnTransform);
-	
-	FRotator leftRotator = SpawnTransform.Rotator();
-	leftRotator.Yaw += -2.5f;
-	
-	SpawnTransform.SetRotation(leftRotator.Quaternion());
-	SpawnProjectile(SpawnTransform);
+	// the inaccuracy moves the whole volley, the pattern keeps its shape
+	ApplyMovementInaccuracy(AimTransform);
 
-	leftRotator.Yaw += 5.f;
-	SpawnTransform.SetRotation(leftRotator.Quaternion());
-	SpawnProjectile(SpawnTransform);
+	CombatMath::GenerateBulletPattern(Pattern, AimTransform, PatternPhase, VolleyTransforms);
+	if (Pattern.Type == EBulletPatternType::Spiral)
+		PatternPhase = FMath::Fmod(PatternPhase + Pattern.SpiralStep, 360.f);
+
+	SpawnProjectileBatch(VolleyTransforms);
 
 	ReleaseToken();
 }
 
 void AEnemyBase::FireDelayedProjectile(float delayTime, int32 numberOfProjectiles)
 {
-	for(int32 i = 0; i != numberOfProjectiles; ++i)
+	if (numberOfProjectiles <= 0)
+		return;
+
+	// The manager ticks the bursts of every enemy in one queue
+	if (CombatManager)
+	{
+		CombatManager->QueueBurst(this, numberOfProjectiles, delayTime, EEnemyBurstPattern::Single);
+		return;
+	}
+
+	// Without a manager we fire the first shot right away and let one looping timer handle the rest.
+	// (Setting the same handle in a loop would overwrite the previous timer and only fire the last shot)
+	FireProjectile();
+	DelayedShotsLeft = numberOfProjectiles - 1;
+
+	if (DelayedShotsLeft > 0)
+		GetWorld()->GetTimerManager().SetTimer(FireTimer, this, &AEnemyBase::FireDelayedProjectileTick, FMath::Max(delayTime, KINDA_SMALL_NUMBER), true);
+}
+
+void AEnemyBase::FireDelayedProjectileTick()
+{
+	if (!bAlive || DelayedShotsLeft <= 0)
+	{
+		GetWorldTimerManager().ClearTimer(FireTimer);
+		DelayedShotsLeft = 0;
+		return;
+	}
+
+	FireProjectile();
+
+	if (--DelayedShotsLeft <= 0)
+		GetWorldTimerManager().ClearTimer(FireTimer);
+}
+
+void AEnemyBase::FireBurstShot(EEnemyBurstPattern Pattern, const FTransform& SpawnTransform)
+{
+	switch (Pattern)
 	{
-		GetWorld()->GetTimerManager().SetTimer(FireTimer,this,&AEnemyBase::FireProjectile,i*delayTime,false);
+	case EEnemyBurstPattern::Triple: FireTripleProjectileFrom(SpawnTransform);
+		break;
+	case EEnemyBurstPattern::Volley: FireVolleyFrom(SpawnTransform, VolleyPattern);
+		break;
+	case EEnemyBurstPattern::Single:
+	default: FireProjectileFrom(SpawnTransform);
+		break;
 	}
 }
 
@@ -754,7 +1182,7 @@ void AEnemyBase::InitiateFire(float PlayRate)
 UNiagaraComponent* AEnemyBase::SpawnFireParticles()
 {
 	if (NS_FireParticle)
-		return UNiagaraFunctionLibrary::SpawnSystemAtLocation(this, NS_FireParticle, GetMesh()->GetSocketLocation("ProjectileSocket"),GetMesh()->GetSocketRotation("ProjectileSocket"));
+		return SpawnCombatFX(NS_FireParticle, GetMesh()->GetSocketLocation("ProjectileSocket"),GetMesh()->GetSocketRotation("ProjectileSocket"));
 
 	return NULL;
 }
@@ -764,48 +1192,78 @@ ACPP_CharacterBase* AEnemyBase::GetPlayer() const
 	return Cast<ACPP_CharacterBase>(UGameplayStatics::GetPlayerPawn(GetWorld(), 0)); 
 }
 
+const FCombatPlayerSnapshot& AEnemyBase::GetPlayerSnapshot() const
+{
+	static const FCombatPlayerSnapshot NoPlayer;
+
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	return CombatSubsystem ? CombatSubsystem->GetPlayerSnapshot() : NoPlayer;
+}
+
 FVector AEnemyBase::RequestNewPosition()
 {
 	if (CombatManager)
 	{
 		FVector newPos = CombatManager->ProvideFreeLocationWithLOS(GetActorLocation(), LocIndex);
-		EnemyController->GetBlackboardComponent()->SetValueAsVector(FName("PatrolPoint"), newPos);
-		EnemyController->GetBlackboardComponent()->SetValueAsBool(FName("bSphereCheck"), false);
+		BlackboardProxy.SetPatrolPoint(newPos);
+		BlackboardProxy.SetSphereCheck(false);
 		return newPos;
 	}
 	return GetActorLocation();
 }
 
-bool AEnemyBase::GetLOS()const
+bool AEnemyBase::GetLOS(float MaxAge)const
 {
-	if (ACPP_CharacterBase* Player = GetPlayer())
-	{
-		FHitResult HitRes;
+	const float Now = GetWorld()->GetTimeSeconds();
+	if (Now - LOSTimeStamp <= MaxAge)
+		return bCachedLOS;
+
+	// the manager didn't get to us in time (or we have no manager), trace ourselves
+	bCachedLOS = TraceLOS();
+	LOSTimeStamp = Now;
+	return bCachedLOS;
+}
 
+bool AEnemyBase::TraceLOS()const
+{
+	const FCombatPlayerSnapshot& Snapshot = GetPlayerSnapshot();
+	if (Snapshot.bValid)
+	{
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(EnemyLOS), false, this);
+		QueryParams.AddIgnoredActor(Snapshot.Player.Get());
+		QueryParams.AddIgnoredActor(GetOwner());
 
-		TArray<AActor*>IgnoreActors;
-		IgnoreActors.Add(PlayerRef);
-		IgnoreActors.Add(GetOwner());
-		//reverse the result, if the trace doesn't hit anything it means we have LOS thus return true, otherwise false
-		return (!UKismetSystemLibrary::SphereTraceSingle(this, GetMesh()->GetSocketLocation(FName("ProjectileSocket")), Player->TargetHere->GetComponentLocation(),
-			25.f, UEngineTypes::ConvertToTraceType(ECC_Visibility),
-			false, IgnoreActors, EDrawDebugTrace::None, HitRes, true));
+		//reverse the result, if the sweep doesn't hit anything it means we have LOS thus return true, otherwise false
+		return !GetWorld()->SweepTestByChannel(GetMuzzleLocation(), Snapshot.TargetLocation, FQuat::Identity,
+			ECC_Visibility, FCollisionShape::MakeSphere(LOSTraceRadius), QueryParams);
 	}
 	
 	// Incase of some error return false
 	return false;
 }
 
+void AEnemyBase::SetCachedLOS(bool bHasLOS, float TimeStamp)
+{
+	bCachedLOS = bHasLOS;
+	LOSTimeStamp = TimeStamp;
+	bLOSTracePending = false;
+}
+
 void AEnemyBase::UpdateLOS()const
 {
-	EnemyController->GetBlackboardComponent()->SetValueAsBool(FName("bHasLOS"), GetLOS());
+	// low tier enemies skip most of their BT service updates
+	if (!ShouldRunAIUpdate(LastLOSUpdateTime))
+		return;
+
+	BlackboardProxy.SetHasLOS(GetLOS(UpdateSettings.LOSMaxAge));
 }
 
 float AEnemyBase::GetDistance()const
 {
-	if (ACPP_CharacterBase* Player = GetPlayer())
+	const FCombatPlayerSnapshot& Snapshot = GetPlayerSnapshot();
+	if (Snapshot.bValid)
 	{
-		return (GetMesh()->GetSocketLocation(FName("ProjectileSocket")) - Player->TargetHere->GetComponentLocation()).Size();
+		return (GetMuzzleLocation() - Snapshot.TargetLocation).Size();
 	}
 
 	// Incase of some error return false
@@ -814,21 +1272,26 @@ float AEnemyBase::GetDistance()const
 
 void AEnemyBase::GetEnemyInfo()const
 {
+	if (!ShouldRunAIUpdate(LastEnemyInfoTime))
+		return;
+
 	// Set HasLOS value in blackboard
-	EnemyController->GetBlackboardComponent()->SetValueAsBool(FName("bHasLOS"), GetLOS());
-
-	float DistanceVariance = 1000.f;		// for now this is a local var but we might want to move this over to the enemy data table if we want more variation
-	float Distance = GetDistance();
-
-	// 0 is EDistane::MeleeRange
-	// 1 is EDistane::PreferredDistance
-	// 2 is EDistance::BadRange
-	if(Distance <= EnemyRow.MeleeAttackRange)
-		EnemyController->GetBlackboardComponent()->SetValueAsEnum(FName("DistanceEnum"),0);
-	else if(Distance<= EnemyRow.PreferredDistance + DistanceVariance && Distance>= EnemyRow.PreferredDistance - DistanceVariance)
-		EnemyController->GetBlackboardComponent()->SetValueAsEnum(FName("DistanceEnum"), 1);
-	else
-		EnemyController->GetBlackboardComponent()->SetValueAsEnum(FName("DistanceEnum"), 2);
+	BlackboardProxy.SetHasLOS(GetLOS(UpdateSettings.LOSMaxAge));
+
+	// the manager classifies the distance of all its enemies in one pass per frame
+	if (CombatManager || !Archetype.IsValid())
+		return;
+
+	BlackboardProxy.SetDistanceEnum(Archetype->GetDistanceBand(FMath::Square(GetDistance())));
+}
+
+void AEnemyBase::SetDistanceBand(uint8 Band)
+{
+	if (Band == DistanceBand)
+		return;
+
+	DistanceBand = Band;
+	BlackboardProxy.SetDistanceEnum(Band);
 }
 
 bool AEnemyBase::GetIsValidPosition(float Radius , float DebugDuration, FColor DebugColor) const
@@ -838,6 +1301,12 @@ bool AEnemyBase::GetIsValidPosition(float Radius , float DebugDuration, FColor D
 		DrawDebugSphere(GetWorld(), GetActorLocation(), Radius, 16, DebugColor, false, DebugDuration);
 	}
 
+	// every manager keeps a spatial hash of its enemies, no physics query or blackboard reads needed
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (CombatManager && CombatSubsystem)
+		return !CombatSubsystem->HasStationaryNeighbour(this, GetActorLocation(), Radius);
+
+	// enemies placed without a manager still do the overlap
 	//Create an ObjectType Array and fill it
 	TArray<TEnumAsByte<EObjectTypeQuery> > TraceObjectTypes;
 	TraceObjectTypes.Add(UEngineTypes::ConvertToObjectType(ECC_Enemy));
@@ -858,8 +1327,7 @@ bool AEnemyBase::GetIsValidPosition(float Radius , float DebugDuration, FColor D
 			if (AEnemyBase* Enemy = Cast<AEnemyBase>(HitActor))
 			{
 				//if there happens to be an enemy in our safe range, check if they are moving or not. if they are still moving this enemy is safe to stop.
-				AEnemyController* otherEnemyController = Cast<AEnemyController>(Enemy->GetController());
-				if(otherEnemyController && !otherEnemyController->GetBlackboardComponent()->GetValueAsBool("bMoving"))
+				if(Enemy->GetBlackboardProxy().IsValid() && !Enemy->GetBlackboardProxy().GetIsMoving())
 					return false;
 			}
 		}
@@ -871,7 +1339,10 @@ bool AEnemyBase::GetIsValidPosition(float Radius , float DebugDuration, FColor D
 
 void AEnemyBase::UpdateIsValidPosition() const
 {
-	EnemyController->GetBlackboardComponent()->SetValueAsBool(FName("bSphereCheck"), GetIsValidPosition());
+	if (!ShouldRunAIUpdate(LastPositionUpdateTime))
+		return;
+
+	BlackboardProxy.SetSphereCheck(GetIsValidPosition());
 }
 
 
@@ -897,13 +1368,13 @@ void AEnemyBase::ReleaseToken()
 
 float AEnemyBase::CalculateIsInView()
 {
-	if (PlayerRef)
+	const FCombatPlayerSnapshot& Snapshot = GetPlayerSnapshot();
+	if (Snapshot.bValid)
 	{
-		FVector PlayerToEnemy = (GetActorLocation() - PlayerRef->GetActorLocation());
-		UKismetMathLibrary::Vector_Normalize(PlayerToEnemy);
+		const FVector PlayerToEnemy = (GetActorLocation() - Snapshot.Location).GetSafeNormal();
 
 		// returns how similar the view vector is to the point the enemy is standing at. 1 means the player is looking exactly at the enemy. If we implement variable FOV we have to perform extra calcs
-		return UKismetMathLibrary::Dot_VectorVector(PlayerRef->GetFirstPersonCameraComponent()->GetForwardVector(), PlayerToEnemy);	
+		return FVector::DotProduct(Snapshot.ViewDirection, PlayerToEnemy);
 	}
 	return 0;
 }
@@ -9,6 +9,10 @@
 
 #include "EnemyData.h"
 #include "EnemyProjectileBase.h"
+#include "CombatTypes.h"
+#include "EnemyBoneTables.h"
+#include "EnemyArchetype.h"
+#include "EnemyBlackboardProxy.h"
 
 #include "../BulletHitInteface.h"
 #include "../DoOnce.h"
@@ -25,7 +29,9 @@ class AEnemySpawner;
 class UNiagaraSystem;
 class UNiagaraComponent;
 class USoundCue;
+class USoundBase;
 class AWaveManager;
+class UCombatSubsystem;
 
 UCLASS()
 class CPPSINNER_API AEnemyBase : public ACharacter, public IBulletHitInteface, public INiagaraParticleCallbackHandler
@@ -38,14 +44,20 @@ public:
 	AEnemyBase();
 
 public:
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
 	virtual void BulletHit_Implementation(FHitResult HitResult, FWeaponHitData WeaponHitData) override;
 
+	// All hits of one shot (i.e shotgun pellets) against this enemy. Damage and weak spots are resolved per hit,
+	// but the sound, blood, infested charge, stagger and blood range test only happen once
+	UFUNCTION(BlueprintCallable, Category = "Combat")
+	virtual void BulletHitBatch(const TArray<FHitResult>& HitResults, const FWeaponHitData& WeaponHitData);
+
+	// Splits the hits of one shot per actor: enemies get one BulletHitBatch (or BulletHit for a single hit), other IBulletHitInteface actors get their hits one by one
+	UFUNCTION(BlueprintCallable, Category = "Combat")
+	static void DispatchBatchedHits(const TArray<FHitResult>& HitResults, const FWeaponHitData& WeaponHitData);
+
 	virtual void ReceiveParticleData_Implementation(const TArray<FBasicParticleData>& Data, UNiagaraSystem* NiagaraSystem);
 
 	void HealEnemy(int32 healAmount);
@@ -92,18 +104,22 @@ protected:
 	UFUNCTION()
 	FTransform CalculateInterception();
 
+	// Turns an aim point into the spawn transform at the muzzle
+	FTransform MakeMuzzleTransform(const FVector& MuzzleLoc, const FVector& AimPoint) const;
+
 	UFUNCTION()
 	void Die();
 	
-	UFUNCTION()
-	void SignalDeath();
-
 	UFUNCTION()
 	void InitiateDissolveEffect();
 
 	UFUNCTION(BlueprintImplementableEvent)
 	void Dissolve();
 
+	// Called after ResetFromPool, undo whatever the Blueprint changed on death (dissolve material, attached effects, ...)
+	UFUNCTION(BlueprintImplementableEvent)
+	void OnResetFromPool();
+
 	UFUNCTION()
 	void ApplyAmmoTypeMultiplier(float& Damage, const EAmmoType& AmmoType);
 
@@ -113,26 +129,52 @@ protected:
 	UFUNCTION()
 	virtual void HandleWeakSpotHit(const FHitResult& HitResult, const FWeakSpot& WeakSpot, const float& Damage);
 
+	// socket of the weak spot the hit bone belongs to, NAME_None if the bone isn't part of one
+	FName GetWeakSpotSocketName(FName BoneName) const;
+
 	UFUNCTION()
 	AEnemyProjectileBase* SpawnProjectile(FTransform& SpawnTransform);
 
+	// Spawns every transform as a projectile (or simulated bullet). No inaccuracy is added here
+	void SpawnProjectileBatch(TArrayView<const FTransform> SpawnTransforms);
+
+	// Adds aim error based on how the player is moving, enemies with a token shoot straight
+	void ApplyMovementInaccuracy(FTransform& SpawnTransform) const;
+
 	UFUNCTION(BlueprintCallable)
 	void FireProjectile();
 
 	UFUNCTION(BlueprintCallable)
 	void FireTripleProjectile();
 
+	void FireProjectileFrom(FTransform SpawnTransform);
+
+	void FireTripleProjectileFrom(FTransform SpawnTransform);
+
+	// Fires one volley of VolleyPattern at the player
+	UFUNCTION(BlueprintCallable)
+	void FireVolley();
+
+	// Generates the whole volley in one call and hands it to the spawning path as a batch
+	void FireVolleyFrom(FTransform AimTransform, const FEnemyBulletPattern& Pattern);
+
 	UFUNCTION(BlueprintCallable)
 	void FireDelayedProjectile(float delayTime = 0.5f, int32 numberOfProjectiles = 3);
 
+	// Fallback for FireDelayedProjectile when there is no manager to queue the burst on
+	UFUNCTION()
+	void FireDelayedProjectileTick();
+
 	UFUNCTION()
 	void PlayStaggerAnimation(const FName& HitBone);
 
 	UFUNCTION(BlueprintCallable)
 	FVector RequestNewPosition();
 
+	// Cached line of sight to the player, the combat manager refreshes it a few enemies per frame.
+	// Falls back to a trace of its own if the cached value is older than MaxAge
 	UFUNCTION(BlueprintCallable)
-	bool GetLOS() const;
+	bool GetLOS(float MaxAge = 0.3f) const;
 
 	UFUNCTION(BlueprintCallable)
 	void UpdateLOS() const;
@@ -156,17 +198,32 @@ protected:
 	UFUNCTION()
 	void PlaySpawningFX();
 
+	// NiagaraComp is the spawning effect, null if the enemy row has no NS_Spawning. It isn't pooled, Blueprint may keep it
 	UFUNCTION(BlueprintImplementableEvent)
 	void AppearFX(UNiagaraComponent* NiagaraComp);
 
+	// Plays a combat sound through the combat subsystem's audio aggregator
+	void PlayCombatSound(USoundBase* Sound, ECombatAudioCategory Category, USceneComponent* AttachTo = nullptr, FName SocketName = NAME_None);
+
+	// Spawns a combat effect from the combat subsystem's FX pool, null if it got culled
+	UNiagaraComponent* SpawnCombatFX(UNiagaraSystem* System, const FVector& Location, const FRotator& Rotation, USceneComponent* AttachTo = nullptr, FName SocketName = NAME_None);
+
 private:
 
 	void SetEnemyData();
 
+	void ApplyBulletHits(TArrayView<const FHitResult> HitResults, const FWeaponHitData& WeaponHitData);
+
 	void RangeTestForBlood(FVector Location, float Radius = 500.0f, float DebugDuration = 0.0f, FColor DebugColor= FColor::Red);
 
 	ACPP_CharacterBase* GetPlayer()const;
 
+	// this frame's player data from the combat subsystem, bValid is false without a player
+	const FCombatPlayerSnapshot& GetPlayerSnapshot() const;
+
+	// hands the simulating ragdoll to the corpse manager's budget
+	void RegisterCorpse();
+
 	float CalculateIsInView();
 
 
@@ -189,6 +246,10 @@ protected:
 	UPROPERTY()
 	FTimerHandle FireTimer;
 
+	// shots left of the burst driven by FireTimer (only used without a combat manager)
+	UPROPERTY()
+	int32 DelayedShotsLeft;
+
 	UPROPERTY()
 	FTimerHandle SpawnTimer;
 
@@ -234,6 +295,26 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Projectile")
 	TSubclassOf<AEnemyProjectileBase>ProjectileClass;
 
+	// Fire bullets through the level's AEnemyBulletManager (plain data, instanced mesh) instead of projectile actors.
+	// Used for bullet hell enemies, falls back to ProjectileClass if the level has no bullet manager
+	UPROPERTY(EditDefaultsOnly, Category = "Projectile")
+	bool bUseSimulatedProjectiles;
+
+	// Used by FireTripleProjectile, 3 bullets over a 5 degree arc by default
+	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Projectile")
+	FEnemyBulletPattern TripleShotPattern;
+
+	// Used by FireVolley and by volley bursts
+	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Projectile")
+	FEnemyBulletPattern VolleyPattern;
+
+	// rotation carried between volleys for spiral patterns
+	UPROPERTY()
+	float PatternPhase;
+
+	// scratch array for the volley being fired
+	TArray<FTransform> VolleyTransforms;
+
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Particle")
 	UNiagaraSystem* NS_FireParticle;
 
@@ -259,8 +340,22 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Blood")
 	UMaterialInterface* BloodDecal;
 
-	UPROPERTY(BlueprintReadOnly, Category = "EnemyData")
-	FEnemyData EnemyRow;
+	// Shared, immutable data of this enemy's data table row
+	TSharedPtr<const FEnemyArchetype> Archetype;
+
+	// bit i is set once weak spot i of the archetype has been activated on this enemy
+	UPROPERTY()
+	uint32 ActivatedWeakSpots;
+
+	// bone index -> weak spot, shared by every enemy of the same archetype
+	TSharedPtr<const FEnemyWeakSpotTable> WeakSpotTable;
+
+	// Root bone of each stagger region -> StaggerState value. Child bones inherit the region of their closest listed parent
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Combat")
+	TMap<FName, uint8> StaggerRegionRoots;
+
+	// bone index -> stagger region, shared by every enemy of this class with the same mesh
+	TSharedPtr<const FEnemyStaggerTable> StaggerTable;
 
 	// Montage containing different attacks			Should include more but currently we only have one animation for testing
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Combat", meta = (AllowPrivateAccess = "true"))
@@ -274,6 +369,44 @@ private:
 	UPROPERTY(BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
 	bool bToken;
 
+	// Radius of the sphere swept from the projectile socket to the player for LOS
+	UPROPERTY(EditDefaultsOnly, Category = "Combat")
+	float LOSTraceRadius;
+
+	// GetLOS is const for the BT services, the cache is refreshed from there too
+	mutable bool bCachedLOS;
+
+	mutable float LOSTimeStamp;
+
+	bool bLOSTracePending;
+
+	bool TraceLOS() const;
+
+	// Blackboard writes by key ID and only when the value changes, reset every time the behavior tree is started
+	FEnemyBlackboardProxy BlackboardProxy;
+
+	void ResetBlackboardProxy();
+
+	UPROPERTY(VisibleAnywhere, Category = "LOD")
+	EEnemyUpdateTier UpdateTier;
+
+	UPROPERTY(VisibleAnywhere, Category = "LOD")
+	FEnemyUpdateTierSettings UpdateSettings;
+
+	// mesh offset inside the capsule, the ragdoll detaches the mesh and pooled enemies have to put it back
+	FTransform MeshRelativeTransform;
+
+	// DistanceEnum last pushed to the blackboard, MAX_uint8 until the first push
+	uint8 DistanceBand;
+
+	// last time each BT service entry point actually did its work
+	mutable float LastEnemyInfoTime;
+	mutable float LastLOSUpdateTime;
+	mutable float LastPositionUpdateTime;
+
+	// true if the AI update interval of the current tier has passed since LastUpdateTime, and restamps it
+	bool ShouldRunAIUpdate(float& LastUpdateTime) const;
+
 	UPROPERTY(EditDefaultsOnly, Category = "Data")
 	UDataTable* EnemyDataTableObject;
 
@@ -302,6 +435,9 @@ private:
 	UPROPERTY()
 	ACPP_CharacterBase* PlayerRef;
 
+	// spawned by the enemy pool only to wait in it, BeginPlay leaves the behavior tree alone
+	bool bPrewarmedForPool;
+
 	//Animation
 
 	FName AttackR;
@@ -327,7 +463,67 @@ public:
 
 	FORCEINLINE bool GetHasToken() const { return bToken;}
 
+	FORCEINLINE bool GetIsAlive() const { return bAlive; }
+
+	// The enemy's data table row, shared by every enemy of the same archetype
+	UFUNCTION(BlueprintPure, Category = "EnemyData")
+	const FEnemyData& GetEnemyRow() const;
+
+	FORCEINLINE TSubclassOf<AEnemyProjectileBase> GetProjectileClass() const { return ProjectileClass; }
+
+	// Every effect this enemy class spawns in combat, so the arena can prewarm the FX pool. Called on the class default object
+	void GatherFXSystems(UCombatSubsystem* CombatSubsystem, TArray<UNiagaraSystem*>& OutSystems) const;
+
+	// Called by the combat manager's burst queue for every shot of a queued burst, the manager already solved the aim for all shots of the frame
+	void FireBurstShot(EEnemyBurstPattern Pattern, const FTransform& SpawnTransform);
+
+	FVector GetMuzzleLocation() const;
+
+	float GetProjectileSpeed() const;
+
 	FORCEINLINE AEnemyController* GetEnemyController() const {return EnemyController;}
 
+	FORCEINLINE const FEnemyBlackboardProxy& GetBlackboardProxy() const { return BlackboardProxy; }
+
+	// Applies the update tier the combat manager picked for this enemy: tick rates, animation, AI and LOS refresh
+	void SetUpdateTier(EEnemyUpdateTier Tier, const FEnemyUpdateTierSettings& Settings);
+
+	FORCEINLINE EEnemyUpdateTier GetUpdateTier() const { return UpdateTier; }
+
+	// null until the enemy data is set
+	FORCEINLINE const FEnemyArchetype* GetArchetype() const { return Archetype.Get(); }
+
+	// Called by the combat manager's distance band pass, only reaches the blackboard when the band changed
+	void SetDistanceBand(uint8 Band);
+
+	FORCEINLINE float GetLOSMaxAge() const { return UpdateSettings.LOSMaxAge; }
+
+	// Called by the combat manager when its LOS trace for this enemy finished
+	void SetCachedLOS(bool bHasLOS, float TimeStamp);
+
+	FORCEINLINE float GetLOSTimeStamp() const { return LOSTimeStamp; }
+
+	FORCEINLINE bool GetIsLOSTracePending() const { return bLOSTracePending; }
+
+	FORCEINLINE void SetLOSTracePending(bool bPending) { bLOSTracePending = bPending; }
+
+	FORCEINLINE float GetLOSTraceRadius() const { return LOSTraceRadius; }
+
+	// Cleans the corpse up (back to the enemy pool or destroyed), the death timer calls it and the corpse manager when it evicts
+	UFUNCTION()
+	void SignalDeath();
+
+	// Called by the corpse manager once the ragdoll came to rest (or ran over the budget), keeps the last pose without physics or skeleton updates
+	void FreezeRagdoll();
+
+	// Parks the enemy for the enemy pool: hidden, no collision, no controller, no tick, no timers
+	void DeactivateForPool();
+
+	// Brings a pooled enemy back to the state of a freshly spawned one, before the spawner runs InitiateSpawn on it
+	void ResetFromPool();
+
+	// Set by the enemy pool before BeginPlay on the enemies it prewarms
+	FORCEINLINE void SetPrewarmedForPool(bool bPrewarmed) { bPrewarmedForPool = bPrewarmed; }
+
 	FORCEINLINE ACPP_CharacterBase* GetPlayerRef() const {return PlayerRef;}
 };
@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyBlackboardProxy.h"
+
+#include "BehaviorTree/BlackboardData.h"
+
+TSharedRef<FEnemyBlackboardKeys> FEnemyBlackboardKeys::Build(const UBlackboardData* BlackboardAsset)
+{
+	TSharedRef<FEnemyBlackboardKeys> Keys = MakeShared<FEnemyBlackboardKeys>();
+
+	if (BlackboardAsset)
+	{
+		Keys->HasLOS = BlackboardAsset->GetKeyID(FName("bHasLOS"));
+		Keys->DistanceEnum = BlackboardAsset->GetKeyID(FName("DistanceEnum"));
+		Keys->SphereCheck = BlackboardAsset->GetKeyID(FName("bSphereCheck"));
+		Keys->PatrolPoint = BlackboardAsset->GetKeyID(FName("PatrolPoint"));
+		Keys->FireRate = BlackboardAsset->GetKeyID(FName("FireRate"));
+		Keys->Target = BlackboardAsset->GetKeyID(FName("Target"));
+		Keys->Moving = BlackboardAsset->GetKeyID(FName("bMoving"));
+	}
+
+	return Keys;
+}
+
+void FEnemyBlackboardProxy::Reset(UBlackboardComponent* InBlackboard, TSharedPtr<const FEnemyBlackboardKeys> InKeys)
+{
+	Blackboard = InBlackboard;
+	Keys = InKeys;
+}
+
+bool FEnemyBlackboardProxy::GetIsMoving() const
+{
+	UBlackboardComponent* BlackboardComponent = Blackboard.Get();
+	if (!BlackboardComponent || !Keys.IsValid() || Keys->Moving == FBlackboard::InvalidKey)
+		return false;
+
+	return BlackboardComponent->GetValue<UBlackboardKeyType_Bool>(Keys->Moving);
+}
@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Bool.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Enum.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Float.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+
+class UBlackboardData;
+
+// Key IDs of the enemy blackboard keys, resolved once per blackboard asset and shared by every enemy using it.
+// A key the asset doesn't have stays FBlackboard::InvalidKey and writes to it are ignored.
+struct CPPSINNER_API FEnemyBlackboardKeys
+{
+	FBlackboard::FKey HasLOS = FBlackboard::InvalidKey;
+	FBlackboard::FKey DistanceEnum = FBlackboard::InvalidKey;
+	FBlackboard::FKey SphereCheck = FBlackboard::InvalidKey;
+	FBlackboard::FKey PatrolPoint = FBlackboard::InvalidKey;
+	FBlackboard::FKey FireRate = FBlackboard::InvalidKey;
+	FBlackboard::FKey Target = FBlackboard::InvalidKey;
+	FBlackboard::FKey Moving = FBlackboard::InvalidKey;
+
+	static TSharedRef<FEnemyBlackboardKeys> Build(const UBlackboardData* BlackboardAsset);
+};
+
+// What the enemy writes to its blackboard goes through here.
+// Keys are used by ID instead of by name and a value is only written if it differs from what the blackboard holds,
+// so the BT services don't pay for the lookup, the observer notifications or a BT re-evaluation when nothing changed.
+class CPPSINNER_API FEnemyBlackboardProxy
+{
+public:
+	// Call again whenever the behavior tree (and with it possibly the blackboard) changes
+	void Reset(UBlackboardComponent* InBlackboard, TSharedPtr<const FEnemyBlackboardKeys> InKeys);
+
+	FORCEINLINE bool IsValid() const { return Blackboard.IsValid() && Keys.IsValid(); }
+
+	void SetHasLOS(bool bHasLOS) const { Write<UBlackboardKeyType_Bool>(Keys.IsValid() ? Keys->HasLOS : FBlackboard::InvalidKey, bHasLOS); }
+
+	// 0 is melee range, 1 is preferred distance, 2 is bad range
+	void SetDistanceEnum(uint8 DistanceEnum) const { Write<UBlackboardKeyType_Enum>(Keys.IsValid() ? Keys->DistanceEnum : FBlackboard::InvalidKey, DistanceEnum); }
+
+	void SetSphereCheck(bool bSphereCheck) const { Write<UBlackboardKeyType_Bool>(Keys.IsValid() ? Keys->SphereCheck : FBlackboard::InvalidKey, bSphereCheck); }
+
+	void SetPatrolPoint(const FVector& PatrolPoint) const { Write<UBlackboardKeyType_Vector>(Keys.IsValid() ? Keys->PatrolPoint : FBlackboard::InvalidKey, PatrolPoint); }
+
+	void SetFireRate(float FireRate) const { Write<UBlackboardKeyType_Float>(Keys.IsValid() ? Keys->FireRate : FBlackboard::InvalidKey, FireRate); }
+
+	void SetTarget(UObject* Target) const { Write<UBlackboardKeyType_Object>(Keys.IsValid() ? Keys->Target : FBlackboard::InvalidKey, Target); }
+
+	bool GetIsMoving() const;
+
+private:
+	template<class TDataClass>
+	void Write(FBlackboard::FKey Key, typename TDataClass::FDataType Value) const
+	{
+		UBlackboardComponent* BlackboardComponent = Blackboard.Get();
+		if (!BlackboardComponent || Key == FBlackboard::InvalidKey)
+			return;
+
+		if (BlackboardComponent->GetValue<TDataClass>(Key) != Value)
+			BlackboardComponent->SetValue<TDataClass>(Key, Value);
+	}
+
+	TWeakObjectPtr<UBlackboardComponent> Blackboard;
+
+	TSharedPtr<const FEnemyBlackboardKeys> Keys;
+};
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyBoneTables.h"
+
+#include "Engine/SkeletalMesh.h"
+
+TSharedRef<FEnemyWeakSpotTable> FEnemyWeakSpotTable::Build(const USkeletalMesh* Mesh, const TArray<FWeakSpot>& WeakSpots)
+{
+	TSharedRef<FEnemyWeakSpotTable> Table = MakeShared<FEnemyWeakSpotTable>();
+
+	// the table stores the weak spot index in an int8
+	check(WeakSpots.Num() <= MAX_int8);
+
+	Table->SocketNames.Reserve(WeakSpots.Num());
+	for (const FWeakSpot& currentWeakSpot : WeakSpots)
+	{
+		// the socket name should be the first boneName in the NameArray + Socket, i.e head -> headSocket
+		FName SocketName = NAME_None;
+		if (currentWeakSpot.weakSpotBoneNames.Num())
+			SocketName = FName(*(currentWeakSpot.weakSpotBoneNames[0].ToString() + TEXT("Socket")));
+
+		Table->SocketNames.Add(SocketName);
+	}
+
+	if (!Mesh)
+		return Table;
+
+	const FReferenceSkeleton& RefSkeleton = Mesh->RefSkeleton;
+
+	for (int32 WeakSpotIndex = 0; WeakSpotIndex != WeakSpots.Num(); ++WeakSpotIndex)
+	{
+		for (const FName& BoneName : WeakSpots[WeakSpotIndex].weakSpotBoneNames)
+		{
+			// bones the mesh doesn't have can never be hit, no need to keep them around
+			if (RefSkeleton.FindBoneIndex(BoneName) != INDEX_NONE && !Table->BoneNameToWeakSpot.Contains(BoneName))
+				Table->BoneNameToWeakSpot.Add(BoneName, static_cast<int8>(WeakSpotIndex));
+		}
+	}
+
+	return Table;
+}
+
+TSharedRef<FEnemyStaggerTable> FEnemyStaggerTable::Build(const USkeletalMesh* Mesh, const TMap<FName, uint8>& RegionRoots)
+{
+	TSharedRef<FEnemyStaggerTable> Table = MakeShared<FEnemyStaggerTable>();
+
+	if (!Mesh)
+		return Table;
+
+	const FReferenceSkeleton& RefSkeleton = Mesh->RefSkeleton;
+	Table->BoneToRegion.Init(0, RefSkeleton.GetNum());
+
+	// parents always come before their children in the reference skeleton, so one pass is enough to inherit down the hierarchy
+	for (int32 BoneIndex = 0; BoneIndex != RefSkeleton.GetNum(); ++BoneIndex)
+	{
+		if (const uint8* Region = RegionRoots.Find(RefSkeleton.GetBoneName(BoneIndex)))
+		{
+			Table->BoneToRegion[BoneIndex] = *Region;
+		}
+		else
+		{
+			const int32 ParentIndex = RefSkeleton.GetParentIndex(BoneIndex);
+			if (ParentIndex != INDEX_NONE)
+				Table->BoneToRegion[BoneIndex] = Table->BoneToRegion[ParentIndex];
+		}
+	}
+
+	return Table;
+}
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "EnemyData.h"
+
+class USkeletalMesh;
+
+// Bone name -> weak spot lookup, compiled once per enemy archetype and skeletal mesh.
+// Lets the hit path find the weak spot with one lookup on the hit's bone name instead of comparing every bone name of every weak spot.
+struct CPPSINNER_API FEnemyWeakSpotTable
+{
+	// only bones that are part of a weak spot (and exist on the mesh) are in here
+	TMap<FName, int8> BoneNameToWeakSpot;
+
+	// per weak spot: the socket the effects attach to (weakSpotBoneNames[0] + "Socket")
+	TArray<FName> SocketNames;
+
+	FORCEINLINE int32 FindWeakSpot(FName BoneName) const
+	{
+		const int8* WeakSpotIndex = BoneNameToWeakSpot.Find(BoneName);
+		return WeakSpotIndex ? *WeakSpotIndex : INDEX_NONE;
+	}
+
+	// Builds the table for the given weak spots. The first weak spot listing a bone wins, same as the old name loop
+	static TSharedRef<FEnemyWeakSpotTable> Build(const USkeletalMesh* Mesh, const TArray<FWeakSpot>& WeakSpots);
+};
+
+// Bone index -> stagger region, resolved once per skeletal mesh.
+// Only the root bone of a region has to be listed, every bone below it in the hierarchy inherits the region.
+struct CPPSINNER_API FEnemyStaggerTable
+{
+	// indexed by bone index of the mesh, 0 means the bone doesn't trigger a stagger
+	TArray<uint8> BoneToRegion;
+
+	FORCEINLINE int32 FindRegion(int32 BoneIndex) const
+	{
+		return BoneToRegion.IsValidIndex(BoneIndex) ? BoneToRegion[BoneIndex] : 0;
+	}
+
+	static TSharedRef<FEnemyStaggerTable> Build(const USkeletalMesh* Mesh, const TMap<FName, uint8>& RegionRoots);
+};
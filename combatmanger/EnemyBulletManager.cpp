@@ -0,0 +1,173 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyBulletManager.h"
+
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+
+#include "CombatSubsystem.h"
+
+// Sets default values
+AEnemyBulletManager::AEnemyBulletManager() : MaxBullets(4096),
+BulletLifeTime(6.f),
+BulletRadius(10.f),
+BulletScale(FVector(0.2f)),
+InitialInstances(256),
+NumUsedInstances(0),
+CombatSubsystem(nullptr)
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PostPhysics;
+
+	BulletInstances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("BulletInstances"));
+	RootComponent = BulletInstances;
+	BulletInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	BulletInstances->SetCastShadow(false);
+	BulletInstances->SetMobility(EComponentMobility::Movable);
+}
+
+// Called when the game starts or when spawned
+void AEnemyBulletManager::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Instances are given in world space, keep the component at the origin
+	SetActorTransform(FTransform::Identity);
+
+	Bullets.Reserve(MaxBullets);
+	InstanceTransforms.Reserve(MaxBullets);
+
+	// one batch of collapsed instances up front, so the first volleys don't add instances at all
+	TArray<FTransform> NewInstances;
+	NewInstances.Init(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), FMath::Clamp(InitialInstances, 0, MaxBullets));
+	if (NewInstances.Num())
+		BulletInstances->AddInstances(NewInstances, false);
+
+	CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (CombatSubsystem)
+		CombatSubsystem->RegisterBulletManager(this);
+}
+
+void AEnemyBulletManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (CombatSubsystem)
+		CombatSubsystem->UnregisterBulletManager(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+int32 AEnemyBulletManager::FireBullets(TArrayView<const FTransform> SpawnTransforms, float Speed, float Damage, const FEnemyHitData& HitData, AActor* BulletInstigator)
+{
+	const int32 ToAdd = FMath::Min(SpawnTransforms.Num(), MaxBullets - Bullets.Num());
+
+	for (int32 i = 0; i < ToAdd; ++i)
+	{
+		Bullets.Emplace(SpawnTransforms[i].GetLocation(), SpawnTransforms[i].GetRotation().GetForwardVector() * Speed, Damage, HitData, BulletLifeTime, BulletInstigator);
+	}
+
+	return FMath::Max(ToAdd, 0);
+}
+
+// Called every frame
+void AEnemyBulletManager::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SimulateBullets(DeltaTime);
+	UpdateInstances();
+}
+
+void AEnemyBulletManager::SimulateBullets(float DeltaTime)
+{
+	if (!Bullets.Num())
+		return;
+
+	// the player's capsule comes from the combat subsystem's snapshot, taken once per frame for all combat code
+	const FCombatPlayerSnapshot* Snapshot = CombatSubsystem ? &CombatSubsystem->GetPlayerSnapshot() : nullptr;
+	AActor* Player = Snapshot && Snapshot->bValid ? Snapshot->Player.Get() : nullptr;
+
+	FVector CapsuleTop = FVector::ZeroVector;
+	FVector CapsuleBottom = FVector::ZeroVector;
+	FVector CapsuleCenter = FVector::ZeroVector;
+	float HitRadius = 0.f;
+	float BroadPhaseExtent = 0.f;
+
+	if (Player)
+	{
+		CapsuleCenter = Snapshot->CapsuleLocation;
+		CapsuleTop = CapsuleCenter + Snapshot->CapsuleUp * Snapshot->CapsuleHalfHeight;
+		CapsuleBottom = CapsuleCenter - Snapshot->CapsuleUp * Snapshot->CapsuleHalfHeight;
+		HitRadius = Snapshot->CapsuleRadius + BulletRadius;
+		BroadPhaseExtent = Snapshot->CapsuleHalfHeight + HitRadius;
+	}
+
+	// go backwards so dead bullets can be swapped out while looping
+	for (int32 i = Bullets.Num() - 1; i >= 0; --i)
+	{
+		FSimulatedBullet& Bullet = Bullets[i];
+
+		Bullet.TimeLeft -= DeltaTime;
+		const FVector Start = Bullet.Position;
+		const FVector End = Start + Bullet.Velocity * DeltaTime;
+		Bullet.Position = End;
+
+		bool bHitPlayer = false;
+		if (Player)
+		{
+			// cheap sphere test first, only bullets close to the player do the swept segment test
+			const float TravelDistance = Bullet.Velocity.Size() * DeltaTime;
+			if (FVector::DistSquared(Start, CapsuleCenter) <= FMath::Square(BroadPhaseExtent + TravelDistance))
+			{
+				FVector OnBullet, OnCapsule;
+				FMath::SegmentDistToSegmentSafe(Start, End, CapsuleBottom, CapsuleTop, OnBullet, OnCapsule);
+				bHitPlayer = FVector::DistSquared(OnBullet, OnCapsule) <= HitRadius * HitRadius;
+
+				if (bHitPlayer)
+				{
+					const FVector ShotDirection = Bullet.Velocity.GetSafeNormal();
+					const FVector HitNormal = (OnBullet - OnCapsule).GetSafeNormal();
+					const FHitResult Hit(Player, Cast<UPrimitiveComponent>(Player->GetRootComponent()), OnCapsule + HitNormal * Snapshot->CapsuleRadius, HitNormal);
+
+					AActor* BulletInstigator = Bullet.Instigator.Get();
+					APawn* InstigatorPawn = Cast<APawn>(BulletInstigator);
+					Player->TakeDamage(Bullet.Damage, FEnemyBulletDamageEvent(Bullet.Damage, Hit, ShotDirection, Bullet.HitData), InstigatorPawn ? InstigatorPawn->GetController() : nullptr, BulletInstigator);
+				}
+			}
+		}
+
+		if (bHitPlayer || Bullet.TimeLeft <= 0.f)
+			Bullets.RemoveAtSwap(i, 1, false);
+	}
+}
+
+void AEnemyBulletManager::UpdateInstances()
+{
+	if (!Bullets.Num() && !NumUsedInstances)
+		return;
+
+	InstanceTransforms.Reset();
+	for (const FSimulatedBullet& Bullet : Bullets)
+	{
+		InstanceTransforms.Emplace(Bullet.Velocity.ToOrientationQuat(), Bullet.Position, BulletScale);
+	}
+
+	// instances that had a bullet last frame but not anymore are collapsed, adding and removing instances per bullet is far more expensive
+	for (int32 i = Bullets.Num(); i < NumUsedInstances; ++i)
+	{
+		InstanceTransforms.Emplace(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+	}
+
+	// only grows, and then by the whole missing amount in one call
+	const int32 MissingInstances = InstanceTransforms.Num() - BulletInstances->GetInstanceCount();
+	if (MissingInstances > 0)
+	{
+		TArray<FTransform> NewInstances;
+		NewInstances.Init(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), MissingInstances);
+		BulletInstances->AddInstances(NewInstances, false);
+	}
+
+	BulletInstances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	NumUsedInstances = Bullets.Num();
+}
@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Engine/EngineTypes.h"
+
+#include "EnemyData.h"
+
+#include "EnemyBulletManager.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UCombatSubsystem;
+
+// One simulated enemy bullet. Plain data, every bullet gets updated in a single pass by the bullet manager
+struct FSimulatedBullet
+{
+	FSimulatedBullet() : Position(FVector::ZeroVector), Velocity(FVector::ZeroVector), Damage(0.f), TimeLeft(0.f) {}
+	FSimulatedBullet(const FVector& InPosition, const FVector& InVelocity, float InDamage, const FEnemyHitData& InHitData, float InLifeTime, AActor* InInstigator) :
+	Position(InPosition), Velocity(InVelocity), Damage(InDamage), HitData(InHitData), TimeLeft(InLifeTime), Instigator(InInstigator) {}
+
+	FVector Position;
+	FVector Velocity;
+	float Damage;
+
+	// same hit data a projectile gets through SetProjectileData (faction, slow)
+	FEnemyHitData HitData;
+
+	float TimeLeft;
+	TWeakObjectPtr<AActor> Instigator;
+};
+
+// Damage event of a simulated bullet hitting the player. It is a point damage event, so TakeDamage handles it like any other shot
+// (ReceivePointDamage, OnTakePointDamage), code that wants the bullet's FEnemyHitData can check for ClassID and cast
+struct CPPSINNER_API FEnemyBulletDamageEvent : public FPointDamageEvent
+{
+	FEnemyBulletDamageEvent(float InDamage, const FHitResult& InHitInfo, const FVector& InShotDirection, const FEnemyHitData& InHitData) :
+	FPointDamageEvent(InDamage, InHitInfo, InShotDirection, UDamageType::StaticClass()), HitData(InHitData) {}
+
+	FEnemyHitData HitData;
+
+	// FPointDamageEvent and FRadialDamageEvent use 1 and 2
+	static const int32 ClassID = 3;
+
+	virtual int32 GetTypeID() const override { return FEnemyBulletDamageEvent::ClassID; }
+	virtual bool IsOfType(int32 InID) const override { return (FEnemyBulletDamageEvent::ClassID == InID) || FPointDamageEvent::IsOfType(InID); }
+};
+
+// Simulates enemy bullets as structs instead of one AEnemyProjectileBase actor per bullet.
+// Bullets only test against the player (swept against the player's capsule) and are drawn with one instanced mesh.
+// Place one in the level, enemies with bUseSimulatedProjectiles send their shots here.
+UCLASS()
+class CPPSINNER_API AEnemyBulletManager : public AActor
+{
+	GENERATED_BODY()
+	
+public:	
+	// Sets default values for this actor's properties
+	AEnemyBulletManager();
+
+	virtual void Tick(float DeltaTime) override;
+
+	// Adds a whole volley at once, bullets over MaxBullets are dropped. Returns how many were added
+	int32 FireBullets(TArrayView<const FTransform> SpawnTransforms, float Speed, float Damage, const FEnemyHitData& HitData, AActor* BulletInstigator);
+
+	FORCEINLINE int32 GetNumBullets() const { return Bullets.Num(); }
+
+protected:
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	void SimulateBullets(float DeltaTime);
+
+	void UpdateInstances();
+
+protected:
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Bullets")
+	UInstancedStaticMeshComponent* BulletInstances;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Bullets")
+	int32 MaxBullets;
+
+	// seconds a bullet lives before it gets removed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Bullets")
+	float BulletLifeTime;
+
+	// added to the player's capsule radius when testing for hits
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Bullets")
+	float BulletRadius;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Bullets")
+	FVector BulletScale;
+
+	// instances created in BeginPlay. The instance count only grows from there, unused instances are collapsed instead of removed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Bullets")
+	int32 InitialInstances;
+
+private:
+	TArray<FSimulatedBullet> Bullets;
+
+	// reused every frame for the instance update
+	TArray<FTransform> InstanceTransforms;
+
+	// instances that showed a bullet after the last update, the ones past the bullet count get collapsed
+	int32 NumUsedInstances;
+
+	UPROPERTY()
+	UCombatSubsystem* CombatSubsystem;
+};
@@ -0,0 +1,132 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyPool.h"
+
+#include "EnemyBase.h"
+
+UEnemyPool::UEnemyPool() : PrewarmPerFrame(1)
+{
+}
+
+void UEnemyPool::QueuePrewarm(TSubclassOf<AEnemyBase> EnemyClass, int32 Count)
+{
+	if (!EnemyClass || Count <= 0)
+		return;
+
+	// waves follow each other, a class only needs as many as the biggest request for it
+	int32& PendingCount = PendingPrewarms.FindOrAdd(EnemyClass);
+	PendingCount = FMath::Max(PendingCount, Count);
+}
+
+void UEnemyPool::Tick()
+{
+	if (!PendingPrewarms.Num() || !GetWorld())
+		return;
+
+	int32 SpawnsLeft = FMath::Max(PrewarmPerFrame, 1);
+
+	for (TMap<UClass*, int32>::TIterator It = PendingPrewarms.CreateIterator(); It && SpawnsLeft > 0; ++It)
+	{
+		FEnemyPoolBucket& Bucket = Buckets.FindOrAdd(It.Key());
+		bool bSpawnFailed = false;
+
+		while (Bucket.Free.Num() < It.Value() && SpawnsLeft > 0)
+		{
+			--SpawnsLeft;
+
+			AEnemyBase* NewEnemy = SpawnPooledEnemy(It.Key(), FTransform::Identity, true);
+			if (!NewEnemy)
+			{
+				bSpawnFailed = true;
+				break;
+			}
+
+			NewEnemy->DeactivateForPool();
+			Bucket.Free.Add(NewEnemy);
+			++Stats.Prewarmed;
+		}
+
+		// done, or the class can't be spawned and would just retry every frame
+		if (bSpawnFailed || Bucket.Free.Num() >= It.Value())
+			It.RemoveCurrent();
+	}
+}
+
+AEnemyBase* UEnemyPool::Acquire(TSubclassOf<AEnemyBase> EnemyClass, const FTransform& SpawnTransform)
+{
+	if (!EnemyClass || !GetWorld())
+		return nullptr;
+
+	AEnemyBase* PooledEnemy = nullptr;
+
+	if (FEnemyPoolBucket* Bucket = Buckets.Find(EnemyClass))
+	{
+		// skip anything that got destroyed behind our back
+		while (Bucket->Free.Num() && !PooledEnemy)
+		{
+			AEnemyBase* Candidate = Bucket->Free.Pop(false);
+			if (IsValid(Candidate))
+				PooledEnemy = Candidate;
+		}
+	}
+
+	if (!PooledEnemy)
+	{
+		// a fresh enemy went through BeginPlay, nothing to reset
+		++Stats.Misses;
+		return SpawnPooledEnemy(EnemyClass, SpawnTransform, false);
+	}
+
+	++Stats.Hits;
+	PooledEnemy->SetActorTransform(SpawnTransform, false, nullptr, ETeleportType::ResetPhysics);
+	PooledEnemy->ResetFromPool();
+	return PooledEnemy;
+}
+
+void UEnemyPool::Release(AEnemyBase* EnemyToRelease)
+{
+	if (!IsValid(EnemyToRelease))
+		return;
+
+	FEnemyPoolBucket& Bucket = Buckets.FindOrAdd(EnemyToRelease->GetClass());
+
+	// releasing twice must not put the enemy in the pool twice
+	if (Bucket.Free.Contains(EnemyToRelease))
+		return;
+
+	EnemyToRelease->DeactivateForPool();
+	Bucket.Free.Add(EnemyToRelease);
+	++Stats.Releases;
+}
+
+int32 UEnemyPool::GetNumFree(TSubclassOf<AEnemyBase> EnemyClass) const
+{
+	const FEnemyPoolBucket* Bucket = Buckets.Find(EnemyClass);
+	return Bucket ? Bucket->Free.Num() : 0;
+}
+
+AEnemyBase* UEnemyPool::SpawnPooledEnemy(TSubclassOf<AEnemyBase> EnemyClass, const FTransform& SpawnTransform, bool bPrewarm)
+{
+	// deferred, so the enemy already knows it's prewarmed when BeginPlay runs
+	AEnemyBase* NewEnemy = GetWorld()->SpawnActorDeferred<AEnemyBase>(EnemyClass, SpawnTransform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn);
+	if (!NewEnemy)
+		return nullptr;
+
+	NewEnemy->SetPrewarmedForPool(bPrewarm);
+
+	// enemies broadcast OnDestroyed themselves when they die, EndPlay is the one that means the actor is really gone
+	NewEnemy->OnEndPlay.AddUniqueDynamic(this, &UEnemyPool::OnPooledEnemyEndPlay);
+
+	NewEnemy->FinishSpawning(SpawnTransform);
+	return NewEnemy;
+}
+
+void UEnemyPool::OnPooledEnemyEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	if (AEnemyBase* EndedEnemy = Cast<AEnemyBase>(Actor))
+	{
+		if (FEnemyPoolBucket* Bucket = Buckets.Find(EndedEnemy->GetClass()))
+			Bucket->Free.RemoveSwap(EndedEnemy);
+	}
+}
@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+
+#include "CombatTypes.h"
+
+#include "EnemyPool.generated.h"
+
+class AEnemyBase;
+
+USTRUCT()
+struct CPPSINNER_API FEnemyPoolBucket
+{
+	GENERATED_BODY()
+
+	// enemies waiting to be reused, hidden, without collision, controller or tick
+	UPROPERTY()
+	TArray<AEnemyBase*> Free;
+};
+
+// Keeps a pool of enemies per class, so fodder waves that respawn all fight long don't spawn, construct and destroy an actor per enemy.
+// Owned by UCombatSubsystem.
+UCLASS(config = Game)
+class CPPSINNER_API UEnemyPool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UEnemyPool();
+
+	// Asks for the pool of this class to hold at least Count free enemies. Tick spawns them, PrewarmPerFrame at a time
+	void QueuePrewarm(TSubclassOf<AEnemyBase> EnemyClass, int32 Count);
+
+	// spawns the next queued prewarm enemies
+	void Tick();
+
+	// Takes an enemy out of the pool (or spawns one if it's empty), resets it and moves it to SpawnTransform.
+	// The caller still runs the spawn sequence (InitiateSpawn) on it
+	AEnemyBase* Acquire(TSubclassOf<AEnemyBase> EnemyClass, const FTransform& SpawnTransform);
+
+	// Puts a dead enemy back in the pool instead of destroying it
+	void Release(AEnemyBase* EnemyToRelease);
+
+	// enemies of this class waiting in the pool
+	int32 GetNumFree(TSubclassOf<AEnemyBase> EnemyClass) const;
+
+	FORCEINLINE const FCombatPoolStats& GetStats() const { return Stats; }
+
+	// enemies prewarmed per frame, each one is a full actor spawn. Set in DefaultGame.ini
+	UPROPERTY(Config)
+	int32 PrewarmPerFrame;
+
+private:
+	// bPrewarm spawns the enemy without starting its behavior tree, it goes straight into the pool
+	AEnemyBase* SpawnPooledEnemy(TSubclassOf<AEnemyBase> EnemyClass, const FTransform& SpawnTransform, bool bPrewarm);
+
+	// if a pooled enemy still gets destroyed (level unload, arena clean up) it has to leave the pool
+	UFUNCTION()
+	void OnPooledEnemyEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+
+	UPROPERTY()
+	TMap<UClass*, FEnemyPoolBucket> Buckets;
+
+	// free enemies each class should end up with, removed once the bucket holds them
+	UPROPERTY()
+	TMap<UClass*, int32> PendingPrewarms;
+
+	UPROPERTY()
+	FCombatPoolStats Stats;
+};
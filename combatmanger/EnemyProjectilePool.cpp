@@ -0,0 +1,211 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemyProjectilePool.h"
+
+#include "GameFramework/ProjectileMovementComponent.h"
+
+void UEnemyProjectilePool::Prewarm(TSubclassOf<AEnemyProjectileBase> ProjectileClass, int32 Count)
+{
+	if (!ProjectileClass || !GetWorld())
+		return;
+
+	FEnemyProjectilePoolBucket& Bucket = Buckets.FindOrAdd(ProjectileClass);
+	Bucket.Free.Reserve(Count);
+
+	while (Bucket.Free.Num() < Count)
+	{
+		AEnemyProjectileBase* NewProjectile = SpawnPooledProjectile(ProjectileClass, FTransform::Identity);
+		if (!NewProjectile)
+			break;
+
+		DeactivateProjectile(NewProjectile);
+		Bucket.Free.Add(NewProjectile);
+		++Stats.Prewarmed;
+	}
+}
+
+AEnemyProjectileBase* UEnemyProjectilePool::Acquire(TSubclassOf<AEnemyProjectileBase> ProjectileClass, const FTransform& SpawnTransform, const FEnemyHitData& HitData, float Speed)
+{
+	if (!ProjectileClass || !GetWorld())
+		return nullptr;
+
+	AEnemyProjectileBase* PooledProjectile = nullptr;
+
+	if (FEnemyProjectilePoolBucket* Bucket = Buckets.Find(ProjectileClass))
+	{
+		// skip anything that got destroyed behind our back
+		while (Bucket->Free.Num() && !PooledProjectile)
+		{
+			AEnemyProjectileBase* Candidate = Bucket->Free.Pop(false);
+			if (IsValid(Candidate))
+				PooledProjectile = Candidate;
+		}
+	}
+
+	if (PooledProjectile)
+	{
+		++Stats.Hits;
+	}
+	else
+	{
+		++Stats.Misses;
+		PooledProjectile = SpawnPooledProjectile(ProjectileClass, SpawnTransform);
+		if (!PooledProjectile)
+			return nullptr;
+	}
+
+	ActivateProjectile(PooledProjectile, SpawnTransform, HitData, Speed);
+
+	// the pool handles the lifespan, a projectile that dies from it would be destroyed instead of coming back
+	const float LifeSpan = PooledProjectile->GetClass()->GetDefaultObject<AActor>()->InitialLifeSpan;
+	PoolIndices.Add(PooledProjectile, Active.Num());
+	Active.Add(PooledProjectile);
+	ActiveExpireTimes.Add(LifeSpan > 0.f ? GetWorld()->GetTimeSeconds() + LifeSpan : MAX_flt);
+
+	return PooledProjectile;
+}
+
+void UEnemyProjectilePool::Release(AEnemyProjectileBase* ProjectileToRelease)
+{
+	if (!IsValid(ProjectileToRelease))
+		return;
+
+	const int32* PoolIndex = PoolIndices.Find(ProjectileToRelease);
+
+	// not one of ours (spawned without the pool), there is nothing to go back to
+	if (!PoolIndex)
+	{
+		ProjectileToRelease->Destroy();
+		return;
+	}
+
+	// already in the pool, releasing twice (i.e hit and lifespan in the same frame) must not add it twice
+	if (*PoolIndex == INDEX_NONE)
+		return;
+
+	RemoveActive(*PoolIndex);
+
+	DeactivateProjectile(ProjectileToRelease);
+	Buckets.FindOrAdd(ProjectileToRelease->GetClass()).Free.Add(ProjectileToRelease);
+	++Stats.Releases;
+}
+
+void UEnemyProjectilePool::Tick(float CurrentTime)
+{
+	for (int32 i = Active.Num() - 1; i >= 0; --i)
+	{
+		if (!IsValid(Active[i]))
+		{
+			PoolIndices.Remove(Active[i]);
+			RemoveActive(i);
+		}
+		else if (ActiveExpireTimes[i] <= CurrentTime)
+			Release(Active[i]);
+	}
+}
+
+void UEnemyProjectilePool::RemoveActive(int32 ActiveIndex)
+{
+	if (int32* PoolIndex = PoolIndices.Find(Active[ActiveIndex]))
+		*PoolIndex = INDEX_NONE;
+
+	Active.RemoveAtSwap(ActiveIndex, 1, false);
+	ActiveExpireTimes.RemoveAtSwap(ActiveIndex, 1, false);
+
+	// the last projectile moved into the hole
+	if (Active.IsValidIndex(ActiveIndex))
+	{
+		if (int32* PoolIndex = PoolIndices.Find(Active[ActiveIndex]))
+			*PoolIndex = ActiveIndex;
+	}
+}
+
+AEnemyProjectileBase* UEnemyProjectilePool::SpawnPooledProjectile(TSubclassOf<AEnemyProjectileBase> ProjectileClass, const FTransform& SpawnTransform)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	AEnemyProjectileBase* NewProjectile = GetWorld()->SpawnActor<AEnemyProjectileBase>(ProjectileClass, SpawnTransform, SpawnParams);
+	if (NewProjectile)
+	{
+		PoolIndices.Add(NewProjectile, INDEX_NONE);
+		NewProjectile->OnDestroyed.AddUniqueDynamic(this, &UEnemyProjectilePool::OnPooledProjectileDestroyed);
+		NewProjectile->OnActorHit.AddUniqueDynamic(this, &UEnemyProjectilePool::OnPooledProjectileHit);
+	}
+
+	return NewProjectile;
+}
+
+void UEnemyProjectilePool::DeactivateProjectile(AEnemyProjectileBase* ProjectileToDeactivate)
+{
+	ProjectileToDeactivate->SetActorHiddenInGame(true);
+	ProjectileToDeactivate->SetActorEnableCollision(false);
+	ProjectileToDeactivate->SetActorTickEnabled(false);
+
+	// a pooled projectile shouldn't die from its lifespan while waiting in the pool
+	ProjectileToDeactivate->SetLifeSpan(0.f);
+
+	if (UProjectileMovementComponent* Movement = ProjectileToDeactivate->FindComponentByClass<UProjectileMovementComponent>())
+	{
+		Movement->StopMovementImmediately();
+		Movement->Deactivate();
+	}
+}
+
+void UEnemyProjectilePool::ActivateProjectile(AEnemyProjectileBase* ProjectileToActivate, const FTransform& SpawnTransform, const FEnemyHitData& HitData, float Speed)
+{
+	ProjectileToActivate->SetActorTransform(SpawnTransform, false, nullptr, ETeleportType::ResetPhysics);
+	ProjectileToActivate->SetProjectileData(HitData, Speed);
+
+	ProjectileToActivate->SetActorHiddenInGame(false);
+	ProjectileToActivate->SetActorEnableCollision(true);
+	ProjectileToActivate->SetActorTickEnabled(true);
+
+	if (UProjectileMovementComponent* Movement = ProjectileToActivate->FindComponentByClass<UProjectileMovementComponent>())
+	{
+		// same state a freshly spawned projectile would start with
+		if (!Movement->UpdatedComponent)
+			Movement->SetUpdatedComponent(ProjectileToActivate->GetRootComponent());
+
+		Movement->Velocity = SpawnTransform.GetRotation().GetForwardVector() * Speed;
+		Movement->Activate(true);
+		Movement->UpdateComponentVelocity();
+	}
+}
+
+void UEnemyProjectilePool::OnPooledProjectileDestroyed(AActor* DestroyedActor)
+{
+	AEnemyProjectileBase* DestroyedProjectile = Cast<AEnemyProjectileBase>(DestroyedActor);
+
+	int32 PoolIndex = INDEX_NONE;
+	if (!DestroyedProjectile || !PoolIndices.RemoveAndCopyValue(DestroyedProjectile, PoolIndex))
+		return;
+
+	if (PoolIndex == INDEX_NONE)
+	{
+		// destroyed while waiting in the pool (level unload, ...)
+		if (FEnemyProjectilePoolBucket* Bucket = Buckets.Find(DestroyedProjectile->GetClass()))
+			Bucket->Free.RemoveSwap(DestroyedProjectile);
+		return;
+	}
+
+	// destroyed in flight, the projectile's own impact code calls Destroy instead of going through ReleaseProjectile
+	RemoveActive(PoolIndex);
+	++Stats.Lost;
+
+	UClass* ProjectileClass = DestroyedProjectile->GetClass();
+	if (!GetWorld()->bIsTearingDown && !DestroyWarnedClasses.Contains(ProjectileClass))
+	{
+		DestroyWarnedClasses.Add(ProjectileClass);
+		UE_LOG(LogTemp, Warning, TEXT("%s destroys pooled projectiles, call ReleaseProjectile on the combat subsystem instead of Destroy"), *ProjectileClass->GetName());
+	}
+}
+
+void UEnemyProjectilePool::OnPooledProjectileHit(AActor* SelfActor, AActor* OtherActor, FVector NormalImpulse, const FHitResult& Hit)
+{
+	// not released right here, we are inside the projectile's move and its own hit handling still has to run
+	const int32* PoolIndex = PoolIndices.Find(Cast<AEnemyProjectileBase>(SelfActor));
+	if (PoolIndex && *PoolIndex != INDEX_NONE)
+		ActiveExpireTimes[*PoolIndex] = 0.f;
+}
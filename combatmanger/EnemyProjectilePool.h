@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+
+#include "EnemyProjectileBase.h"
+#include "CombatTypes.h"
+
+#include "EnemyProjectilePool.generated.h"
+
+USTRUCT()
+struct CPPSINNER_API FEnemyProjectilePoolBucket
+{
+	GENERATED_BODY()
+
+	// projectiles waiting to be reused, they are hidden, without collision and with their movement stopped
+	UPROPERTY()
+	TArray<AEnemyProjectileBase*> Free;
+};
+
+// Keeps a pool of enemy projectiles per ProjectileClass, so bullet heavy fights don't spawn and destroy an actor for every shot.
+// The pool takes over the projectile's lifespan and releases it when it runs out, or the frame after the projectile hit something.
+// Owned by UCombatSubsystem.
+UCLASS()
+class CPPSINNER_API UEnemyProjectilePool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Spawns projectiles up front until the pool of this class holds at least Count free ones
+	void Prewarm(TSubclassOf<AEnemyProjectileBase> ProjectileClass, int32 Count);
+
+	// Takes a projectile out of the pool (or spawns one if it's empty) and resets it for a new shot
+	AEnemyProjectileBase* Acquire(TSubclassOf<AEnemyProjectileBase> ProjectileClass, const FTransform& SpawnTransform, const FEnemyHitData& HitData, float Speed);
+
+	// Puts a projectile back in the pool. Projectiles that handle their own impact have to call this instead of Destroy,
+	// a pooled projectile that destroys itself is lost to the pool. Projectiles the pool didn't spawn are destroyed
+	void Release(AEnemyProjectileBase* ProjectileToRelease);
+
+	// releases the projectiles that ran out of lifespan or hit something last frame
+	void Tick(float CurrentTime);
+
+	FORCEINLINE const FCombatPoolStats& GetStats() const { return Stats; }
+
+private:
+	AEnemyProjectileBase* SpawnPooledProjectile(TSubclassOf<AEnemyProjectileBase> ProjectileClass, const FTransform& SpawnTransform);
+
+	void DeactivateProjectile(AEnemyProjectileBase* ProjectileToDeactivate);
+
+	void ActivateProjectile(AEnemyProjectileBase* ProjectileToActivate, const FTransform& SpawnTransform, const FEnemyHitData& HitData, float Speed);
+
+	// if a projectile still destroys itself we have to make sure it's not left in the pool
+	UFUNCTION()
+	void OnPooledProjectileDestroyed(AActor* DestroyedActor);
+
+	// a blocking hit ends the shot, the projectile goes back to the pool on the next Tick
+	UFUNCTION()
+	void OnPooledProjectileHit(AActor* SelfActor, AActor* OtherActor, FVector NormalImpulse, const FHitResult& Hit);
+
+	void RemoveActive(int32 ActiveIndex);
+
+	// every projectile the pool spawned, with its index in Active or INDEX_NONE while it waits in the pool
+	TMap<AEnemyProjectileBase*, int32> PoolIndices;
+
+	// classes we already warned about destroying their pooled projectiles
+	TSet<UClass*> DestroyWarnedClasses;
+
+	UPROPERTY()
+	TMap<UClass*, FEnemyProjectilePoolBucket> Buckets;
+
+	// projectiles in flight and the time the pool takes them back
+	UPROPERTY()
+	TArray<AEnemyProjectileBase*> Active;
+
+	TArray<float> ActiveExpireTimes;
+
+	UPROPERTY()
+	FCombatPoolStats Stats;
+};
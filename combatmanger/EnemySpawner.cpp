@@ -7,6 +7,8 @@
 #include "DrawDebugHelpers.h"
 
 #include "WaveManager.h"
+#include "CombatSubsystem.h"
+#include "EnemyPool.h"
 
 #include "../CPP_GameInstance.h"
 #include "Chaos/Collision/CollisionApplyType.h"
@@ -15,10 +17,12 @@
 #include "Kismet/KismetMathLibrary.h"
 
 // Sets default values
-AEnemySpawner::AEnemySpawner() : bKeepSpawning(false), secondarySpawnTime(2.0f), bSpawnOnGround(true)
+AEnemySpawner::AEnemySpawner() : bKeepSpawning(false), secondarySpawnTime(2.0f), bSpawnOnGround(true), bBakedOnGround(false)
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	// Nothing to do per frame, spawning is timer driven.
+	// Blueprint children can still turn ticking on if they need it
 	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
 
 }
 
@@ -30,13 +34,77 @@ void AEnemySpawner::BeginPlay()
 	nEnemies = PositionArray.Num();
 	
 	GameInstanceRef = Cast<UCPP_GameInstance>(UGameplayStatics::GetGameInstance(GetWorld()));
+
+	// fallback for spawners that weren't baked in the editor (or moved since), still cheaper than tracing per spawn
+	if (!IsBakeValid())
+		BakeGroundPositions();
 }
 
-// Called every frame
-void AEnemySpawner::Tick(float DeltaTime)
+void AEnemySpawner::OnConstruction(const FTransform& Transform)
 {
-	Super::Tick(DeltaTime);
+	Super::OnConstruction(Transform);
+
+	if (BakedSpawnPositions.Num() && !IsBakeValid())
+		BakedSpawnPositions.Reset();
+}
+
+void AEnemySpawner::PostLoad()
+{
+	Super::PostLoad();
+
+#if WITH_EDITORONLY_DATA
+	if (EnemyType)
+	{
+		if (SoftEnemyType.IsNull())
+			SoftEnemyType = EnemyType;
+
+		EnemyType = nullptr;
+	}
+#endif
+}
+
+bool AEnemySpawner::IsBakeValid() const
+{
+	return BakedSpawnPositions.Num() == PositionArray.Num()
+		&& bBakedOnGround == bSpawnOnGround
+		&& BakedFromPositions == PositionArray
+		&& BakedTransform.Equals(GetActorTransform());
+}
+
+void AEnemySpawner::BakeGroundPositions()
+{
+	UWorld* World = GetWorld();
+	if (!World)
+		return;
+
+	Modify();
+
+	const FTransform& ActorTransform = GetActorTransform();
+
+	BakedSpawnPositions.Reset(PositionArray.Num());
+
+	for (const FVector& Position : PositionArray)
+	{
+		// if bSpawnOnGround , we want to find the ground
+		if (bSpawnOnGround)
+		{
+			const FVector Start = Position + GetActorLocation();
+			const FVector End = Start + FVector(0.0f, 0.0f, -1.0f) * 2500.f;
+
+			FHitResult HitResult;
+			World->LineTraceSingleByChannel(HitResult, Start, End, ECC_Visibility);
+
+			BakedSpawnPositions.Add(HitResult.bBlockingHit ? FVector(HitResult.ImpactPoint) : Start + FVector(0.f, 0.f, 15.f));
+		}
+		else
+		{
+			BakedSpawnPositions.Add(ActorTransform.TransformPosition(Position));
+		}
+	}
 
+	BakedFromPositions = PositionArray;
+	BakedTransform = ActorTransform;
+	bBakedOnGround = bSpawnOnGround;
 }
 
 void AEnemySpawner::SetWaveManager(AWaveManager* WaveManager)
@@ -44,41 +112,36 @@ void AEnemySpawner::SetWaveManager(AWaveManager* WaveManager)
 	waveManagerRef = WaveManager;
 }
 
-AEnemyBase* AEnemySpawner::SpawnUnit(const FVector& position)
+AEnemyBase* AEnemySpawner::SpawnUnit(int32 PositionIndex)
 {
-	FVector spawnPosition = position;
+	if (!PositionArray.IsValidIndex(PositionIndex))
+		return nullptr;
 
 	FActorSpawnParameters SpawnParams;
 	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
 	
 	AEnemyBase* Enemy;
-	// if bSpawnOnGround , we want to find the ground
-	if(bSpawnOnGround)
-	{
-		spawnPosition += GetActorLocation();
-		FHitResult HitResult;
 
-		FVector End = spawnPosition + FVector(0.0f,0.0f,-1.0f) * 2500.f;
-		
-		GetWorld()->LineTraceSingleByChannel(HitResult,spawnPosition,End,ECC_Visibility);
-		if(HitResult.bBlockingHit)
-		{
-			End = HitResult.ImpactPoint;
-		}
-		else
-		{
-			End = spawnPosition;
-			End.Z += 15.f;
-		}
+	// the ground was traced when the positions got baked, only a spawner that moved since needs a new bake
+	if (!IsBakeValid())
+		BakeGroundPositions();
 
-		spawnPosition = UKismetMathLibrary::InverseTransformLocation(GetActorTransform(),End);
-		
-		Enemy = GetWorld()->SpawnActor<AEnemyBase>(EnemyType, UKismetMathLibrary::TransformLocation(GetActorTransform(),spawnPosition), FRotator::ZeroRotator, SpawnParams);
-	}
+	const FVector& WorldPosition = BakedSpawnPositions[PositionIndex];
+
+	// normally streamed in by the combat manager's preload, without it we have to take the hitch here
+	TSubclassOf<AEnemyBase> EnemyClass = SoftEnemyType.Get();
+	if (!EnemyClass)
+		EnemyClass = SoftEnemyType.LoadSynchronous();
+
+	if (!EnemyClass)
+		return nullptr;
+
+	// reuse a dead enemy of the same class if the pool has one
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (CombatSubsystem && CombatSubsystem->GetEnemyPool())
+		Enemy = CombatSubsystem->GetEnemyPool()->Acquire(EnemyClass, FTransform(FRotator::ZeroRotator, WorldPosition));
 	else
-	{
-		Enemy = GetWorld()->SpawnActor<AEnemyBase>(EnemyType, UKismetMathLibrary::TransformLocation(GetActorTransform(),spawnPosition), FRotator::ZeroRotator, SpawnParams);
-	}
+		Enemy = GetWorld()->SpawnActor<AEnemyBase>(EnemyClass, WorldPosition, FRotator::ZeroRotator, SpawnParams);
 
 	if(Enemy)
 	{
@@ -101,9 +164,22 @@ AEnemyBase* AEnemySpawner::SpawnUnit(const FVector& position)
 void AEnemySpawner::SpawnEnemies(AWaveManager* WaveManager)
 {
 	SetWaveManager(WaveManager);
+
+	// the manager spreads the spawns over several frames, the wave counts them as pending until they are in
+	ACombatManager* CombatManager = WaveManager ? WaveManager->GetCombatManager() : nullptr;
 	
-	for (const FVector& currentPos : PositionArray)
-		SpawnUnit(currentPos);
+	for (int32 i = 0; i != PositionArray.Num(); ++i)
+	{
+		if (CombatManager)
+		{
+			WaveManager->AddPendingSpawn();
+			CombatManager->QueueSpawn(this, WaveManager, i);
+		}
+		else
+		{
+			SpawnUnit(i);
+		}
+	}
 	
 }
 
@@ -135,7 +211,7 @@ void AEnemySpawner::spawnFodder()
 
 	int32 spawnPosID = UKismetMathLibrary::RandomIntegerInRange(0,nEnemies-1);
 
-	SpawnUnit(PositionArray[spawnPosID]);
+	SpawnUnit(spawnPosID);
 	
 	// perform a check if we are still waiting for another fodder to spawn, since we just cleared the timer when entering this function
 	if(SpawnedActors.Num() < nEnemies && GameInstanceRef && GameInstanceRef->bPlayerInCombat)
@@ -27,24 +27,45 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Drops the baked positions once the spawner or its PositionArray changed
+	virtual void OnConstruction(const FTransform& Transform) override;
+
+	// Moves the hard EnemyType of spawners saved before SoftEnemyType existed over to it
+	virtual void PostLoad() override;
+
 	UFUNCTION()
 	void spawnFodder();
 
 	UFUNCTION()
 	void ClearChainEnemy(AEnemyBase* EnemyToRemove);
 
-	UFUNCTION()
-	AEnemyBase* SpawnUnit(const FVector& position);
-
 public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	// Spawns (or takes from the enemy pool) one enemy at PositionArray[PositionIndex]
+	UFUNCTION()
+	AEnemyBase* SpawnUnit(int32 PositionIndex);
 
+	// Queues every position on the combat manager's spawn queue, or spawns them right away without a manager
 	void SpawnEnemies(AWaveManager* CombatManager);
 
 	void RemoveEnemy(AEnemyBase* EnemyToRemove);
 
 	void SetWaveManager(AWaveManager* WaveManager);
+
+	// null until the enemy class is loaded, see ACombatManager::StartPreload
+	FORCEINLINE TSubclassOf<AEnemyBase> GetEnemyType() const { return SoftEnemyType.Get(); }
+
+	FORCEINLINE const TSoftClassPtr<AEnemyBase>& GetEnemyTypeAsset() const { return SoftEnemyType; }
+
+	// Traces the ground under every spawn point once and stores the world space spawn positions,
+	// run it in the editor to save the traces at runtime, BeginPlay bakes whatever isn't baked yet
+	UFUNCTION(CallInEditor, Category = "Spawner")
+	void BakeGroundPositions();
+
+	// true if BakedSpawnPositions were made for the current transform and PositionArray
+	bool IsBakeValid() const;
+
+	// number of enemies this spawner puts in the arena at once
+	FORCEINLINE int32 GetSpawnCount() const { return PositionArray.Num(); }
 	
 	UPROPERTY()
 	TArray<AEnemyBase*>SpawnedActors;
@@ -65,8 +86,16 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spawner", meta = (MakeEditWidget = "true"))
 	TArray<FVector>PositionArray;
 
+	// soft so the enemy (and everything it references) streams in with the arena's preload instead of loading on the first spawn
 	UPROPERTY(EditDefaultsOnly, Category = "Spawner")
+	TSoftClassPtr<AEnemyBase> SoftEnemyType;
+
+#if WITH_EDITORONLY_DATA
+	// The hard reference spawners used to be saved with, kept under its old name so existing levels and Blueprints still load it.
+	// PostLoad moves it to SoftEnemyType and clears it, resaving drops it for good. Never in cooked data
+	UPROPERTY()
 	TSubclassOf<AEnemyBase> EnemyType;
+#endif
 
 	UPROPERTY()
 	ACombatManager* combatManager;
@@ -79,4 +108,18 @@ protected:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Spawner")
 	bool bSpawnOnGround;
+
+	// World space spawn position per PositionArray entry, ground snapped if bSpawnOnGround
+	UPROPERTY(VisibleAnywhere, Category = "Spawner")
+	TArray<FVector> BakedSpawnPositions;
+
+	// what the positions were baked from, a bake is only valid while these still match
+	UPROPERTY()
+	TArray<FVector> BakedFromPositions;
+
+	UPROPERTY()
+	FTransform BakedTransform;
+
+	UPROPERTY()
+	bool bBakedOnGround;
 };
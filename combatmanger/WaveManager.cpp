@@ -6,16 +6,21 @@
 #include "CombatManager.h"
 #include "EnemyBase.h"
 #include "EnemySpawner.h"
+#include "CombatSubsystem.h"
+#include "EnemyPool.h"
 
 
 // Sets default values
 AWaveManager::AWaveManager() : bFodderWave(false),
 combatManagerRef(NULL),
 nEnemiesToNext(0),
-bNextWaveCalled(false)
+bNextWaveCalled(false),
+nPendingSpawns(0)
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	// Nothing to do per frame, spawning and wave progress are event driven.
+	// Blueprint children can still turn ticking on if they need it
 	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
 }
 
 // Called when the game starts or when spawned
@@ -25,12 +30,6 @@ void AWaveManager::BeginPlay()
 	
 }
 
-// Called every frame
-void AWaveManager::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-}
-
 AWaveManager* AWaveManager::SpawnWave(ACombatManager* CombatManager)
 {
 	if(CombatManager)
@@ -44,6 +43,35 @@ AWaveManager* AWaveManager::SpawnWave(ACombatManager* CombatManager)
 	return this;
 }
 
+void AWaveManager::GatherPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const
+{
+	for (const AEnemySpawner* currentSpawner : managedSpawners)
+	{
+		if (currentSpawner && !currentSpawner->GetEnemyTypeAsset().IsNull())
+			OutAssets.AddUnique(currentSpawner->GetEnemyTypeAsset().ToSoftObjectPath());
+	}
+}
+
+void AWaveManager::PrewarmEnemies() const
+{
+	UCombatSubsystem* CombatSubsystem = GetWorld()->GetSubsystem<UCombatSubsystem>();
+	if (!CombatSubsystem || !CombatSubsystem->GetEnemyPool())
+		return;
+
+	// several spawners can spawn the same class, the pool needs the sum of them. The pool spawns them over the next frames
+	TMap<UClass*, int32> EnemiesPerClass;
+	for (const AEnemySpawner* currentSpawner : managedSpawners)
+	{
+		if (currentSpawner && currentSpawner->GetEnemyType())
+			EnemiesPerClass.FindOrAdd(currentSpawner->GetEnemyType()) += currentSpawner->GetSpawnCount();
+	}
+
+	for (const TPair<UClass*, int32>& current : EnemiesPerClass)
+	{
+		CombatSubsystem->GetEnemyPool()->QueuePrewarm(current.Key, current.Value);
+	}
+}
+
 // this will be called from the EnemySpawner, once it spawned the enemy in question
 void AWaveManager::addSpawnedEnemy(AEnemyBase* EnemyToAdd)
 {
@@ -53,7 +81,10 @@ void AWaveManager::addSpawnedEnemy(AEnemyBase* EnemyToAdd)
 		spawnedEnemies.Add(EnemyToAdd);
 
 		if(combatManagerRef)
+		{
 			EnemyToAdd->SetCombatManager(combatManagerRef);
+			combatManagerRef->AddManagedActor(EnemyToAdd);		// so the manager's per frame passes (LOS, spacing, update tiers) see it
+		}
 	}
 }
 
@@ -72,9 +103,27 @@ void AWaveManager::RemoveEnemy(AEnemyBase* EnemyToRemove)
 	InitiateNextWave();
 }
 
+void AWaveManager::AddPendingSpawn()
+{
+	++nPendingSpawns;
+}
+
+void AWaveManager::OnPendingSpawnDone(bool bSpawned)
+{
+	nPendingSpawns = FMath::Max(nPendingSpawns - 1, 0);
+
+	// a spawn that never happened can be the one the wave was waiting for
+	if (!bSpawned)
+	{
+		WaveCompleted();
+		InitiateNextWave();
+	}
+}
+
 void AWaveManager::InitiateNextWave()
 {
-	if(spawnedEnemies.Num() <= nEnemiesToNext && !bFodderWave && combatManagerRef && !bNextWaveCalled)
+	// enemies still in the spawn queue count as alive, otherwise the first kills of a wave could start the next one
+	if(spawnedEnemies.Num() + nPendingSpawns <= nEnemiesToNext && !bFodderWave && combatManagerRef && !bNextWaveCalled)
 	{
 		combatManagerRef->SpawnNextWave(waveID);
 		bNextWaveCalled = true;
@@ -83,6 +132,11 @@ void AWaveManager::InitiateNextWave()
 
 void AWaveManager::KillSpawnedEnemies()
 {
+	// whatever didn't spawn yet never will
+	if(combatManagerRef)
+		combatManagerRef->CancelQueuedSpawns(this);
+	nPendingSpawns = 0;
+
 	for(AEnemyBase* currentEnemy : spawnedEnemies)
 	{
 		currentEnemy->DieFromSpawn();
@@ -103,7 +157,7 @@ void AWaveManager::KillSpawners()
 
 void AWaveManager::WaveCompleted()
 {
-	if(!bFodderWave && 0 == spawnedEnemies.Num() && combatManagerRef)
+	if(!bFodderWave && 0 == spawnedEnemies.Num() && 0 == nPendingSpawns && combatManagerRef)
 		combatManagerRef->SetWaveCompleted(waveID);
 }
 
@@ -35,6 +35,24 @@ public:
 	UFUNCTION()
 	void KillSpawnedEnemies();
 
+	FORCEINLINE const TArray<AEnemySpawner*>& GetManagedSpawners() const { return managedSpawners; }
+
+	// Queues as many enemies of every class as this wave spawns at once for the enemy pool
+	void PrewarmEnemies() const;
+
+	// Adds the enemy classes of this wave's spawners, for the combat manager's preload
+	void GatherPreloadAssets(TArray<FSoftObjectPath>& OutAssets) const;
+
+	FORCEINLINE ACombatManager* GetCombatManager() const { return combatManagerRef; }
+
+	// A spawn of this wave waits in the combat manager's spawn queue, it counts as an enemy of the wave until it's done
+	void AddPendingSpawn();
+
+	// The spawn queue got to one of our spawns, bSpawned is false if it didn't produce an enemy (spawner gone, spawn failed)
+	void OnPendingSpawnDone(bool bSpawned);
+
+	FORCEINLINE int32 GetPendingSpawns() const { return nPendingSpawns; }
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -75,10 +93,8 @@ protected:
 
 	UPROPERTY()
 	bool bNextWaveCalled;
-private:
 
-	
-public:
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	// spawns still waiting in the combat manager's spawn queue
+	UPROPERTY()
+	int32 nPendingSpawns;
 };